@@ -27,192 +27,291 @@
 #include <stdio.h>
 #include "pico/stdlib.h"
 #include "hardware/uart.h"
+#include "hardware/irq.h"
 #include "tusb.h"
 #include "PicoX68Key.h"
 #include "bsp/board_api.h"
-
-#include "include/layout_us.h"
-
-#define KB_UART_ID uart1
-#define KB_BAUD_RATE 2400
-
-#define KB_UART_TX_PIN 4
-#define KB_UART_RX_PIN 5
-
-#define MOUSE_UART_ID uart0
-#define MOUSE_BAUD_RATE 4800
-
-#define MOUSE_UART_TX_PIN 12
-#define MOUSE_UART_RX_PIN 13
-
-#define MOUSE_DIVIDER 0x03
+#include "x68k_port.h"
+#include "mouse.h"
+#include "layout.h"
+#include "stats.h"
+#include "macro.h"
+#include "typematic.h"
+#include "config.h"
+#include "layers.h"
+#include "joystick.h"
+#include "status_led.h"
+#include "recorder.h"
+#include "typer.h"
+#include "remote.h"
+#include "keystate.h"
+
+// The X68000 mouse only has two buttons, so the rest become keys.
+#define MOUSE_MIDDLE_SCAN OPT1_SCAN
+#define MOUSE_WHEEL_UP_SCAN 0x38    // ROLL UP
+#define MOUSE_WHEEL_DOWN_SCAN 0x39  // ROLL DOWN
+#define MOUSE_WHEEL_MAX_STEPS 4
+
+// Left GUI chords handled by the adaptor itself.
+#define CHORD_NEXT_LAYOUT 0x45      // F12
+#define CHORD_STATS_DUMP  0x44      // F11
+#define CHORD_MACRO_REC   0x42      // F9, then a digit to save into that slot
+#define CHORD_MACRO_FIRST 0x1E      // 1-9, 0 play macro slots 0-9
+#define CHORD_MACRO_LAST  0x27
+#define CHORD_MOUSE_CURVE 0x43      // F10
+#define CHORD_REMAP       0x40      // F7, then the key to change, then the key it should act as
+#define CHORD_REMAP_CLEAR 0x3F      // F6
+#define CHORD_RECORDER    0x41      // F8, freeze the flight recorder and send it
+#define CHORD_TYPE_FILE   0x17      // T, type a text file from a USB stick
 
 void press(uint8_t c);
 void keyDown(uint8_t c);
 void keyUp(uint8_t c);
  
-// void typeCodeForDebug(uint8_t c);
 // void testMessage()
 
 extern void hid_app_task(void);
 
-// Press a key
+// Press a key. Played out by the macro engine, so it never blocks.
 void press(uint8_t c) {
-    keyDown(c);
-    sleep_ms(10);
-    keyUp(c);
-    sleep_ms(10);
+    macroTap(c);
 }
 
 // Send the bytes to the X68000's keyboard interface
 void keyDown(uint8_t c) {
-    uart_putc(KB_UART_ID, c);
+    macroNoteLive(c);
+    kbSend(c);
+    typematicPress(c);
 }
 
 void keyUp(uint8_t c) {
-    uart_putc(KB_UART_ID, c | 0x80);
+    typematicRelease(c);
+    macroNoteLive(c | 0x80);
+    kbSend(c | 0x80);
 }
 
-// True while Left GUI (Windows) key is being held. Unlocks additional keys.
-bool isSpecial = false;
+// Remap entry: after the chord, the next key pressed is the one to change
+// and the one after that is what it should send. Neither reaches the X68000.
+static uint8_t remapStep = 0;
+static uint8_t remapFrom = 0;
+static uint8_t remapSwallow[2];
+static uint8_t remapSwallowCount = 0;
+
+static bool remapCapture(uint8_t keycode, uint8_t state) {
+    if(state == USBKEY_RELEASED) {
+        for(uint8_t i = 0; i < remapSwallowCount; i++) {
+            if(remapSwallow[i] == keycode) {
+                remapSwallow[i] = 0;
+                return true;
+            }
+        }
+        return false;
+    }
 
-void setSpecial(bool enabled) {
-    isSpecial = enabled;
+    if(!remapStep || state != USBKEY_PRESSED) return false;
+
+    remapSwallow[remapSwallowCount++] = keycode;
+
+    if(remapStep == 1) {
+        remapFrom = keycode;
+        remapStep = 2;
+    }else{
+        configRemap(remapFrom, layoutLookup(LAYOUT_LAYER_NORMAL, keycode));
+        remapStep = 0;
+    }
+    return true;
 }
 
 // Translate keystrokes from USB Boot Protocol "Usages" to X68000 scan codes
-uint8_t newKeyCode = 0;
-
 void handleKey(uint8_t keycode, uint8_t state) {
-    
-    newKeyCode = keymapping[keycode];
 
-    if(isSpecial) {
-        for(uint8_t i = 0; i < sizeof(altKeysUSB); i++) {
-            if(altKeysUSB[i] == keycode) {
-                newKeyCode = altKeyCodes[i];
-            }
-        }
+    // Left GUI holds the special layer, which also unlocks the chords below.
+    // Chords act on the press alone. Releases carry on to layersKey(), which
+    // ignores keys it never sent, so a key pressed before Left GUI and let go
+    // while it's held still gets its break code.
+    const bool isChord = layersActive(LAYOUT_LAYER_SPECIAL) && state == USBKEY_PRESSED;
+
+    configNoteActivity();
+
+    // Any key stops a file being typed, and goes no further.
+    if(typerBusy() && state == USBKEY_PRESSED) {
+        typerAbort();
+        return;
     }
 
-    if(newKeyCode == 0) return;
-    
-    if(state == USBKEY_PRESSED) {
-        keyDown(newKeyCode);
-    }else if(state == USBKEY_RELEASED) {
-        keyUp(newKeyCode);
+    if(isChord && keycode == CHORD_TYPE_FILE) {
+        typerStart();
+        return;
     }
-}
 
+    if(isChord && keycode == CHORD_NEXT_LAYOUT) {
+        layoutSelect((layoutCurrent() + 1) % layoutCount());
+        configChanged();
+        return;
+    }
 
-// Accumulate deltas from USB HID Mouse reports.
-uint8_t mouseButtons = 0;
-int16_t mouseDx = 0, mouseDy = 0;
+    if(isChord && keycode == CHORD_MOUSE_CURVE) {
+        mouseSetCurve((mouseGetCurve() + 1) % MOUSE_CURVE_COUNT);
+        configChanged();
+        return;
+    }
 
-void handleMouse(uint8_t buttons, int8_t x, int8_t y) {
-    mouseDx += x / MOUSE_DIVIDER;
-    mouseDy += y / MOUSE_DIVIDER;
-    mouseButtons = buttons;
-}
+    if(isChord && keycode == CHORD_REMAP_CLEAR) {
+        configClearRemaps();
+        return;
+    }
 
-// Blink Pico's LED a bit
-void blink() {
-    for(int i = 0; i <= 5; i++){
-        gpio_put(PICO_DEFAULT_LED_PIN, 1);
-        sleep_ms(20);
-        gpio_put(PICO_DEFAULT_LED_PIN, 0);
-        sleep_ms(20);
+    if(isChord && keycode == CHORD_REMAP) {
+        remapStep = 1;
+        remapSwallowCount = 0;
+        return;
     }
-}
 
-// A lil tiny blink
-void littleBlink() {
-    gpio_put(PICO_DEFAULT_LED_PIN, 1);
-    sleep_ms(30);
-    gpio_put(PICO_DEFAULT_LED_PIN, 0);
-    sleep_ms(30);
-}
+    if(remapCapture(keycode, state)) return;
 
-int main()
-{
-    uint8_t lastByte = 0;
-    
-    tuh_hid_set_default_protocol(HID_PROTOCOL_BOOT);
-    tuh_init(BOARD_TUH_RHPORT);
-    board_init_after_tusb();
+    if(isChord && keycode == CHORD_RECORDER) {
+        recorderFreeze();
+        return;
+    }
 
-    uart_init(KB_UART_ID, KB_BAUD_RATE);
-    uart_init(MOUSE_UART_ID, MOUSE_BAUD_RATE);
-    uart_set_format(MOUSE_UART_ID, 8, 2, UART_PARITY_NONE);
-    
-    gpio_set_function(KB_UART_TX_PIN, GPIO_FUNC_UART);
-    gpio_set_function(KB_UART_RX_PIN, GPIO_FUNC_UART);
+    if(isChord && keycode == CHORD_STATS_DUMP) {
+        statsDump();
+        return;
+    }
 
-    gpio_set_function(MOUSE_UART_TX_PIN, GPIO_FUNC_UART);
-    gpio_set_function(MOUSE_UART_RX_PIN, GPIO_FUNC_UART);
+    if(isChord && keycode == CHORD_MACRO_REC) {
+        if(macroRecording()) macroRecordCancel(); else macroRecordStart();
+        return;
+    }
 
+    if(isChord && keycode >= CHORD_MACRO_FIRST && keycode <= CHORD_MACRO_LAST) {
+        const uint8_t slot = keycode - CHORD_MACRO_FIRST;
+        if(macroRecording()) {
+            macroRecordStop(slot);
+            configChanged();
+        }else{
+            macroPlay(slot);
+        }
+        return;
+    }
 
-    gpio_init(PICO_DEFAULT_LED_PIN);
-    gpio_set_dir(PICO_DEFAULT_LED_PIN, GPIO_OUT);
-    
-    while (true) {
-        tuh_task();
-        hid_app_task();
+    const uint64_t start = statNow();
 
-        // Serial port messages should be rare, so not worth making this interrupt driven.
-        while(uart_is_readable(KB_UART_ID)){
+    layersKey(keycode, state);
 
-            const uint8_t thisByte = uart_getc(KB_UART_ID);
+    statCount(STAT_EVT_KEYS);
+    statSince(STAT_TRANSLATE, start);
+}
 
-            // 0x4x replicates the MSCTRL pin on the mouse port. Bit 0 falling means poll now.
-            if(thisByte == 0x40 && lastByte == 0x41){
-                uint8_t mousePacket[3];
-                uint8_t xOvp = 0, xOvn = 0, yOvp = 0, yOvn = 0;
 
-                // Mouse deltas have 10 bits of precision, packed awkwardly into 3 bytes.
-                if (mouseDx > 127)  xOvp = 1;
-                if (mouseDx < -128) xOvn = 1;
-                if (mouseDy > 127)	yOvp = 1;
-                if (mouseDy < -128) yOvn = 1;
+// Accumulate deltas from USB HID Mouse reports. Core1 collects them when polled.
+static mouseMotion_t mouseMotion = { 0, 0 };
+static bool middleWasPressed = false;
 
-                mousePacket[0] = (yOvn << 7) | (yOvp << 6) | (xOvn << 5) | (xOvp << 4) | mouseButtons;
-                mousePacket[1] = mouseDx;
-                mousePacket[2] = mouseDy;
-                mouseDx = 0;
-                mouseDy = 0;
-                for (int i = 0; i < 3; i++) uart_putc(MOUSE_UART_ID, mousePacket[i]);
+void handleMouse(uint8_t buttons, int16_t x, int16_t y, int8_t wheel) {
+    int32_t dx, dy;
 
-            }
+    statCount(STAT_EVT_MOUSE_REPORTS);
+    configNoteActivity();
+    mouseScale(&mouseMotion, x, y, &dx, &dy);
+    mouseAccumulate(buttons & (MOUSE_X68_LEFT | MOUSE_X68_RIGHT), dx, dy);
 
-            // 0x8x sets the keyboard LEDs.
-            if(thisByte & 0x80) {
-                // CAPS -> CAPS
-                // INS -> NUMLOCK
-                // FULLWIDTH -> SCROLL LOCK
-                // I guess?
+    const bool middlePressed = buttons & MOUSE_X68_MIDDLE;
+    if(middlePressed && !middleWasPressed) keyDown(MOUSE_MIDDLE_SCAN);
+    if(!middlePressed && middleWasPressed) keyUp(MOUSE_MIDDLE_SCAN);
+    middleWasPressed = middlePressed;
 
-                set_leds((thisByte >> 4) & 1, (thisByte >> 3) & 1, (thisByte >> 6) & 1);
+    // One ROLL key tap per detent, within reason.
+    const uint8_t wheelKey = wheel > 0 ? MOUSE_WHEEL_UP_SCAN : MOUSE_WHEEL_DOWN_SCAN;
+    int8_t steps = wheel > 0 ? wheel : -wheel;
+    if(steps > MOUSE_WHEEL_MAX_STEPS) steps = MOUSE_WHEEL_MAX_STEPS;
+    while(steps--) {
+        keyDown(wheelKey);
+        keyUp(wheelKey);
+    }
+}
 
-            }
+// Sleep between events rather than spinning on tuh_task(). Set to 0 to get
+// the old busy loop back, e.g. to compare STAT_WAKE or supply current.
+#define LOW_POWER_IDLE 1
 
-            lastByte = thisByte;
-        }
+// Backstop in case something needs looking at without raising an interrupt.
+#define IDLE_MAX_MS 10
+
+static volatile uint32_t usbIrqUs = 0;
+static volatile bool usbIrqSeen = false;
+
+// Runs alongside TinyUSB's own handler, just to note when work turned up.
+static void usbIrqStamp(void) {
+    if(!usbIrqSeen) {
+        usbIrqUs = time_us_32();
+        usbIrqSeen = true;
     }
+}
 
+// Everything that gives the main loop work either raises an interrupt on this
+// core (USB, alarms) or comes from core1 with a SEV (LED changes), and both
+// wake WFE. One that lands between the check and the WFE leaves the event
+// register set, so it can't be missed.
+static void idleWait(void) {
+    static uint64_t idleUs = 0;
+
+    if(tuh_task_event_ready()) return;
+
+    const uint64_t start = statNow();
+    best_effort_wfe_or_timeout(make_timeout_time_ms(IDLE_MAX_MS));
+    idleUs += statNow() - start;
+
+    statCount(STAT_EVT_SLEEPS);
+    statEvents[STAT_EVT_IDLE_MS] = idleUs / 1000;
 }
 
-// void typeCodeForDebug(uint8_t c) {
-//
-//   static const uint8_t hexDigitToKeycodeLut[] = {0x0B, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x1E, 0x2E, 0x2C, 0x20, 0x13, 0x21};
-//   const uint8_t highNibble = (c & 0xf0) >> 4;
-//   const uint8_t lowNibble = c & 0x0f;
+int main()
+{
+    layoutSelect(0);
+    mouseSetCurve(MOUSE_CURVE_LINEAR);
+    configLoad();
+
+    // The X68000 side lives on core1 from here on. Everything a freshly
+    // mounted device could touch is up before USB starts, so a keyboard that
+    // was plugged in at power-on gets its first key through straight away.
+    x68kPortInit();
+    joystickInit();
+    statusLedInit();
+    recorderInit();
+
+    // Report protocol, so we get full resolution mice and NKRO keyboards.
+    // Devices we can't make sense of are switched back to boot at mount.
+    tuh_hid_set_default_protocol(HID_PROTOCOL_REPORT);
+    tuh_init(BOARD_TUH_RHPORT);
+    board_init_after_tusb();
 
-//   press(hexDigitToKeycodeLut[highNibble]);
-//   press(hexDigitToKeycodeLut[lowNibble]);
+    irq_add_shared_handler(USBCTRL_IRQ, usbIrqStamp, PICO_SHARED_IRQ_HANDLER_HIGHEST_ORDER_PRIORITY);
     
-//   press(0x35);
+    while (true) {
+        if(usbIrqSeen) {
+            statRecord(STAT_WAKE, time_us_32() - usbIrqUs);
+            usbIrqSeen = false;
+        }
+
+        const uint64_t start = statNow();
+        tuh_task();
+        statSince(STAT_TUH_TASK, start);
 
-// }
+        hid_app_task();
+        keyStateTask();
+        statsTask();
+        configTask();
+        recorderTask();
+        typerTask();
+        remoteTask();
+
+#if LOW_POWER_IDLE
+        idleWait();
+#endif
+    }
+
+}
 
 // void testMessage() {
 
@@ -4,12 +4,21 @@
 #define USBKEY_HELD     2
 #define USBKEY_RELEASED 4
 
+// Button bits passed to handleMouse. Left and right match the X68000 packet.
+#define MOUSE_X68_LEFT   1
+#define MOUSE_X68_RIGHT  2
+#define MOUSE_X68_MIDDLE 4
+
 // Camel case in my new code
+void keyDown(uint8_t c);
+void keyUp(uint8_t c);
 void handleKey(uint8_t keycode, uint8_t state);
-void handleMouse(uint8_t buttons, int8_t x, int8_t y);
-void setSpecial(bool enabled);
-void blink();
-void littleBlink();
+void handleMouse(uint8_t buttons, int16_t x, int16_t y, int8_t wheel);
 
 // This case used in hid_app.c to keep style consistent
 void set_leds(bool numLock, bool capsLock, bool scrollLock);
+
+// Input from the serial remote, merged with the USB devices'.
+void hid_app_remote_key(uint8_t usage, bool pressed);
+void hid_app_remote_mouse(uint8_t buttons, int8_t x, int8_t y, int8_t wheel);
+void hid_app_remote_release(void);
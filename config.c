@@ -0,0 +1,254 @@
+// Settings kept in flash: layout, mouse curve, remaps and macros.
+//
+// The last few sectors of flash hold a log of fixed size records, each a
+// complete snapshot with a sequence number. At boot the newest complete one
+// is used where it sits in XIP, with nothing to parse. Saving appends the
+// next record and only erases a sector when the log wraps into it, so wear is
+// spread over the whole area and the previous record survives until the new
+// one is fully written (its commit word goes in last).
+//
+// Flash can't be read while it's being written, so both cores stop for the
+// duration. Saves therefore wait until the keyboard and mouse have been quiet
+// for a while and nothing is queued for the X68000, and the erase and the
+// program are done on separate passes of the main loop. An erase also waits
+// for the X68000 to stop polling the mouse, within reason.
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/flash.h"
+#include "hardware/flash.h"
+#include "config.h"
+#include "mouse.h"
+#include "macro.h"
+#include "x68k_port.h"
+
+#define CONFIG_MAGIC   0x4B383658   // "X68K"
+#define CONFIG_VERSION 1
+#define CONFIG_COMMIT  0x600DC0DE
+
+#define CONFIG_SECTORS     4
+#define CONFIG_RECORD_SIZE 2048     // Whole pages, and whole records per sector
+#define CONFIG_SLOTS       (CONFIG_SECTORS * FLASH_SECTOR_SIZE / CONFIG_RECORD_SIZE)
+#define CONFIG_OFFSET      (PICO_FLASH_SIZE_BYTES - CONFIG_SECTORS * FLASH_SECTOR_SIZE)
+
+// flash_safe_execute parks core1 for the whole operation, so nothing goes to
+// the X68000 and nothing reads from it. The keyboard UART runs with its FIFO
+// off, so it holds one received byte and overruns on the next. Programming a
+// record takes ~3ms, less than a byte at 2400 baud, but erasing a sector takes
+// ~45ms, long enough to lose a 0x49 and leave key data stopped. Two seconds
+// with no keys or mouse means nobody is likely to notice either.
+#define CONFIG_SAVE_IDLE_MS 2000
+#define CONFIG_LOCKOUT_MS   100
+
+// So the erase waits for the X68000 to go quiet. A mouse driver polls
+// forever, though, so it only waits so long; past that a poll or two is lost.
+#define CONFIG_HOST_QUIET_MS    1000
+#define CONFIG_HOST_WAIT_MAX_MS 30000
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    uint16_t version;
+    uint16_t size;
+    uint8_t layout;
+    uint8_t curve;
+    uint8_t remapCount;
+    uint8_t reserved;
+    layoutKey_t remaps[CONFIG_MAX_REMAPS];
+    uint8_t macroLength[MACRO_SLOTS];
+    macroStep_t macros[MACRO_SLOTS][MACRO_SLOT_STEPS];
+    uint32_t commit;
+} configRecord_t;
+
+_Static_assert(sizeof(configRecord_t) <= CONFIG_RECORD_SIZE, "config record doesn't fit its slot");
+
+// Programming works in whole pages.
+#define CONFIG_PROGRAM_SIZE ((sizeof(configRecord_t) + FLASH_PAGE_SIZE - 1) & ~(FLASH_PAGE_SIZE - 1))
+
+typedef enum {
+    SAVE_IDLE = 0,
+    SAVE_ERASE,
+    SAVE_PROGRAM
+} saveState_t;
+
+static const configRecord_t *current = NULL;
+static uint8_t currentSlot = CONFIG_SLOTS - 1;
+
+// Remaps are read from the current record until the first edit.
+static const layoutKey_t *remaps = NULL;
+static uint8_t remapCount = 0;
+static layoutKey_t remapsRam[CONFIG_MAX_REMAPS];
+
+static union {
+    configRecord_t record;
+    uint8_t bytes[CONFIG_PROGRAM_SIZE];
+} staged;
+
+static saveState_t saveState = SAVE_IDLE;
+static uint8_t targetSlot = 0;
+static bool dirty = false;
+static uint32_t lastActivityMs = 0;
+static uint32_t eraseWaitMs = 0;
+
+static const configRecord_t *slotAt(uint8_t slot) {
+    return (const configRecord_t *)(uintptr_t)(XIP_BASE + CONFIG_OFFSET + slot * CONFIG_RECORD_SIZE);
+}
+
+static bool recordValid(const configRecord_t *r) {
+    return r->magic == CONFIG_MAGIC && r->version == CONFIG_VERSION &&
+           r->size == sizeof(configRecord_t) && r->commit == CONFIG_COMMIT;
+}
+
+static bool slotBlank(uint8_t slot) {
+    const uint32_t *p = (const uint32_t *)slotAt(slot);
+    for(uint32_t i = 0; i < CONFIG_PROGRAM_SIZE / 4; i++) {
+        if(p[i] != 0xFFFFFFFF) return false;
+    }
+    return true;
+}
+
+static bool sectorStart(uint8_t slot) {
+    return (slot * CONFIG_RECORD_SIZE) % FLASH_SECTOR_SIZE == 0;
+}
+
+void configLoad(void) {
+    for(uint8_t i = 0; i < CONFIG_SLOTS; i++) {
+        const configRecord_t *r = slotAt(i);
+        if(!recordValid(r)) continue;
+        if(current && (int32_t)(r->seq - current->seq) <= 0) continue;
+        current = r;
+        currentSlot = i;
+    }
+
+    if(!current) return;
+
+    remaps = current->remaps;
+    remapCount = current->remapCount <= CONFIG_MAX_REMAPS ? current->remapCount : 0;
+    layoutSetRemaps(remaps, remapCount);
+    layoutSelect(current->layout);
+    mouseSetCurve(current->curve);
+
+    // The recorder writes macros in place, so they're the one thing copied.
+    for(uint8_t i = 0; i < MACRO_SLOTS; i++) {
+        macroSlotLength[i] = current->macroLength[i] <= MACRO_SLOT_STEPS ? current->macroLength[i] : 0;
+    }
+    memcpy(macroSlots, current->macros, sizeof(macroSlots));
+}
+
+void configChanged(void) {
+    dirty = true;
+    configNoteActivity();
+}
+
+void configNoteActivity(void) {
+    lastActivityMs = to_ms_since_boot(get_absolute_time());
+}
+
+static void remapsToRam(void) {
+    if(remaps == remapsRam) return;
+    if(remapCount) memcpy(remapsRam, remaps, remapCount * sizeof(layoutKey_t));
+    remaps = remapsRam;
+}
+
+bool configRemap(uint8_t usb, uint8_t x68) {
+    remapsToRam();
+
+    uint8_t i = 0;
+    while(i < remapCount && remapsRam[i].usb != usb) i++;
+    if(i == CONFIG_MAX_REMAPS) return false;
+    if(i == remapCount) remapCount++;
+
+    remapsRam[i] = (layoutKey_t){ usb, x68 };
+    layoutSetRemaps(remaps, remapCount);
+    configChanged();
+    return true;
+}
+
+void configClearRemaps(void) {
+    remapsToRam();
+    remapCount = 0;
+    layoutSetRemaps(remaps, remapCount);
+    configChanged();
+}
+
+static void stage(void) {
+    configRecord_t *r = &staged.record;
+
+    memset(staged.bytes, 0xFF, sizeof(staged.bytes));
+    memset(r, 0, sizeof(*r));
+
+    r->magic = CONFIG_MAGIC;
+    r->seq = current ? current->seq + 1 : 1;
+    r->version = CONFIG_VERSION;
+    r->size = sizeof(configRecord_t);
+    r->layout = layoutCurrent();
+    r->curve = mouseGetCurve();
+    r->remapCount = remapCount;
+    if(remapCount) memcpy(r->remaps, remaps, remapCount * sizeof(layoutKey_t));
+    memcpy(r->macroLength, macroSlotLength, sizeof(r->macroLength));
+    memcpy(r->macros, macroSlots, sizeof(r->macros));
+    r->commit = CONFIG_COMMIT;
+}
+
+// Everything between the header and the commit word.
+static bool stagedMatchesCurrent(void) {
+    const size_t from = offsetof(configRecord_t, layout);
+    const size_t to = offsetof(configRecord_t, commit);
+    return current && !memcmp((const uint8_t *)&staged.record + from, (const uint8_t *)current + from, to - from);
+}
+
+static void eraseTarget(void *param) {
+    flash_range_erase(CONFIG_OFFSET + targetSlot * CONFIG_RECORD_SIZE, FLASH_SECTOR_SIZE);
+}
+
+static void programTarget(void *param) {
+    flash_range_program(CONFIG_OFFSET + targetSlot * CONFIG_RECORD_SIZE, staged.bytes, CONFIG_PROGRAM_SIZE);
+}
+
+void configTask(void) {
+    switch(saveState) {
+        case SAVE_IDLE:
+            if(!dirty) return;
+            if(to_ms_since_boot(get_absolute_time()) - lastActivityMs < CONFIG_SAVE_IDLE_MS) return;
+            if(!ringEmpty(&kbTxQueue) || macroRecording()) return;
+
+            dirty = false;
+            stage();
+            if(stagedMatchesCurrent()) return;
+
+            // Never erase the sector holding the current record. If the next
+            // slot isn't clean (a save cut short), move on to the next sector.
+            targetSlot = (currentSlot + 1) % CONFIG_SLOTS;
+            if(!sectorStart(targetSlot) && !slotBlank(targetSlot)) {
+                while(!sectorStart(targetSlot)) targetSlot = (targetSlot + 1) % CONFIG_SLOTS;
+            }
+            saveState = sectorStart(targetSlot) ? SAVE_ERASE : SAVE_PROGRAM;
+            eraseWaitMs = to_ms_since_boot(get_absolute_time());
+        break;
+
+        case SAVE_ERASE:
+            if(x68kPortMsSinceCommand() < CONFIG_HOST_QUIET_MS &&
+               to_ms_since_boot(get_absolute_time()) - eraseWaitMs < CONFIG_HOST_WAIT_MAX_MS) return;
+
+            // Other core didn't stop in time. Try again next pass.
+            if(flash_safe_execute(eraseTarget, NULL, CONFIG_LOCKOUT_MS) != PICO_OK) return;
+            saveState = SAVE_PROGRAM;
+        break;
+
+        case SAVE_PROGRAM:
+            if(flash_safe_execute(programTarget, NULL, CONFIG_LOCKOUT_MS) != PICO_OK) return;
+            saveState = SAVE_IDLE;
+
+            if(recordValid(slotAt(targetSlot))) {
+                current = slotAt(targetSlot);
+                currentSlot = targetSlot;
+
+                // The old record's sector will be erased eventually.
+                if(remaps != remapsRam) {
+                    remaps = current->remaps;
+                    layoutSetRemaps(remaps, remapCount);
+                }
+            }
+        break;
+    }
+}
@@ -0,0 +1,29 @@
+// Settings kept in flash: layout, mouse curve, remaps and macros.
+
+#ifndef _CONFIG_H_INCLUDED
+#define _CONFIG_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "layout.h"
+
+#define CONFIG_MAX_REMAPS 32
+
+// Apply the newest saved record, if there is one. Call before anything
+// depends on the layout or mouse curve.
+void configLoad(void);
+
+// Something worth saving changed. The write happens later, once things go quiet.
+void configChanged(void);
+
+// Key or mouse traffic, which pushes any pending save back.
+void configNoteActivity(void);
+
+// Main loop. Does at most one flash operation per call.
+void configTask(void);
+
+// Make usb send x68 on every layout, or drop all remaps.
+bool configRemap(uint8_t usb, uint8_t x68);
+void configClearRemaps(void);
+
+#endif
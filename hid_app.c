@@ -23,9 +23,17 @@
  *
  */
 
+#include <string.h>
 #include "bsp/board_api.h"
 #include "tusb.h"
 #include "PicoX68Key.h"
+#include "x68k_port.h"
+#include "keystate.h"
+#include "hid_plan.h"
+#include "stats.h"
+#include "joystick.h"
+#include "status_led.h"
+#include "recorder.h"
 
 // Modified for brevity, for full explanation, see original source:
 // https://github.com/raspberrypi/pico-examples/blob/master/usb/host/host_cdc_msc_hid/hid_app.c
@@ -34,238 +42,528 @@
 // MACRO TYPEDEF CONSTANT ENUM DECLARATION
 //--------------------------------------------------------------------+
 
-#define MAX_REPORT  8
-
-// Each HID instance can has multiple reports
-static struct
+// One entry per mounted HID interface, found through hid_slot[dev_addr][instance]
+// so several keyboards and mice behind a hub each keep their own state.
+// Each interface gets its report descriptor compiled into a plan at mount.
+// Without a usable plan we fall back to boot protocol.
+// Control requests still to send after mount, in order.
+enum
 {
-  uint8_t report_count;
-  tuh_hid_report_info_t report_info[MAX_REPORT];
-}hid_info[CFG_TUH_HID];
-
-static void process_kbd_report(hid_keyboard_report_t const *report);
-static void process_mouse_report(hid_mouse_report_t const * report);
-static void process_generic_report(uint8_t dev_addr, uint8_t instance, uint8_t const* report, uint16_t len);
+  HID_SETUP_IDLE = 0,     // SET_IDLE 0: only report on change
+  HID_SETUP_PROTOCOL,     // SET_PROTOCOL boot, when we have no plan
+  HID_SETUP_DONE
+};
 
-void hid_app_task(void)
+typedef struct
 {
-  // nothing to do
+  bool in_use;
+  bool has_plan;
+  bool has_leds;
+  bool wants_boot;
+  uint8_t setup_stage;
+  uint8_t led_sent;       // LED state the keyboard last accepted
+  uint8_t led_buf[2];     // Report ID, if any, then LEDs. Must stay put while the transfer is in flight
+  uint8_t dev_addr;
+  uint8_t instance;
+  uint8_t consumer_key;   // Keyboard usage held by a consumer control
+  uint8_t buttons;        // MOUSE_X68_ bits
+  uint8_t joy;            // JOY_ bits
+  uint16_t rate_count;    // Reports so far this rate window
+  uint32_t rate_start;    // Start of the window, ms
+  keyBitmap_t keys;
+  hidPlan_t plan;
+} hid_device_t;
+
+static hid_device_t hid_devices[CFG_TUH_HID];
+
+// Index into hid_devices plus one, zero when nothing is mounted there.
+static uint8_t hid_slot[CFG_TUH_DEVICE_MAX + 1][CFG_TUH_HID];
+
+// What the X68000 last asked for. Keyboards are brought up to date one
+// control transfer at a time, so a burst of LED commands costs at most one
+// transfer per keyboard.
+static uint8_t led_want = 0;
+
+// TinyUSB runs one control transfer at a time across all devices.
+static bool ctrl_busy = false;
+static uint8_t ctrl_addr = 0;
+
+// Reports are copied here and the endpoint re-armed straight away, then
+// handled from hid_app_task, so the next report can be on its way in while
+// this one is translated. Must be a power of two.
+#define HID_REPORT_SLOTS 16
+
+typedef struct
+{
+  uint64_t arrival;
+  uint8_t dev_addr;       // Zero once its device has gone
+  uint8_t instance;
+  uint8_t len;
+  uint8_t data[CFG_TUH_HID_EPIN_BUFSIZE];
+} hid_report_slot_t;
+
+static hid_report_slot_t report_slots[HID_REPORT_SLOTS];
+static uint16_t report_head = 0, report_tail = 0;
+
+static void ctrl_task(void);
+static void process_report(hid_report_slot_t const *slot);
+static void note_report_rate(hid_device_t *dev);
+static void process_kbd_report(hid_device_t *dev, hid_keyboard_report_t const *report);
+static void process_mouse_report(hid_device_t *dev, hid_mouse_report_t const * report, uint16_t len);
+
+static hid_device_t *find_device(uint8_t dev_addr, uint8_t instance)
+{
+  if ( dev_addr > CFG_TUH_DEVICE_MAX || instance >= CFG_TUH_HID ) return NULL;
+  uint8_t const slot = hid_slot[dev_addr][instance];
+  return slot ? &hid_devices[slot - 1] : NULL;
 }
 
-static bool got_keyboard = false;
-static uint8_t keyboard_addr = 0, keyboard_instance = 0;
+static hid_device_t *alloc_device(uint8_t dev_addr, uint8_t instance)
+{
+  if ( dev_addr > CFG_TUH_DEVICE_MAX || instance >= CFG_TUH_HID ) return NULL;
 
-void set_leds(bool numLock, bool capsLock, bool scrollLock) {
+  for ( uint8_t i = 0; i < CFG_TUH_HID; i++ )
+  {
+    if ( !hid_devices[i].in_use )
+    {
+      memset(&hid_devices[i], 0, sizeof(hid_devices[i]));
+      hid_devices[i].in_use = true;
+      hid_devices[i].dev_addr = dev_addr;
+      hid_devices[i].instance = instance;
+      hid_slot[dev_addr][instance] = i + 1;
+      return &hid_devices[i];
+    }
+  }
+  return NULL;
+}
+
+// Keys and buttons held over the serial remote, which joins in like one more device.
+static keyBitmap_t remote_keys;
+static uint8_t remote_buttons = 0;
 
-  uint8_t leds = (numLock ? 1 : 0) + (capsLock ? 2 : 0) + (scrollLock ? 4 : 0);
+// The X68000 sees one keyboard: whatever any of them is holding down.
+static void update_keys(void)
+{
+  keyBitmap_t keys = remote_keys;
 
-  if(got_keyboard){
-    tuh_hid_set_report(keyboard_addr, keyboard_instance, 0, HID_REPORT_TYPE_OUTPUT, &leds, sizeof(leds));
+  for ( uint8_t i = 0; i < CFG_TUH_HID; i++ )
+  {
+    if ( !hid_devices[i].in_use ) continue;
+    keyBitmapOr(&keys, &hid_devices[i].keys);
+    if ( hid_devices[i].consumer_key ) keyBitmapSet(&keys, hid_devices[i].consumer_key);
   }
 
+  keyStateUpdate(&keys);
 }
 
-//--------------------------------------------------------------------+
-// TinyUSB Callbacks
-//--------------------------------------------------------------------+
-
-// Invoked when device with hid interface is mounted
-// Report descriptor is also available for use. tuh_hid_parse_report_descriptor()
-// can be used to parse common/simple enough descriptor.
-// Note: if report descriptor length > CFG_TUH_ENUMERATION_BUFSIZE, it will be skipped
-// therefore report_desc = NULL, desc_len = 0
-void tuh_hid_mount_cb(uint8_t dev_addr, uint8_t instance, uint8_t const* desc_report, uint16_t desc_len)
+// Likewise one mouse. Motion adds up on its own, buttons are the union.
+static void update_mouse(hid_device_t *dev, uint8_t buttons, int16_t x, int16_t y, int8_t wheel)
 {
-  // Interface protocol (hid_interface_protocol_enum_t)
-  uint8_t const itf_protocol = tuh_hid_interface_protocol(dev_addr, instance);
+  if ( dev ) dev->buttons = buttons; else remote_buttons = buttons;
 
-  if ( itf_protocol == HID_ITF_PROTOCOL_NONE )
+  uint8_t all = remote_buttons;
+  for ( uint8_t i = 0; i < CFG_TUH_HID; i++ )
   {
-    hid_info[instance].report_count = tuh_hid_parse_report_descriptor(hid_info[instance].report_info, MAX_REPORT, desc_report, desc_len);
+    if ( hid_devices[i].in_use ) all |= hid_devices[i].buttons;
   }
 
-  if (itf_protocol == HID_ITF_PROTOCOL_KEYBOARD) {
-    got_keyboard = true;
-    keyboard_addr = dev_addr;
-    keyboard_instance = instance;
-  }
+  handleMouse(all, x, y, wheel);
+}
 
-  tuh_hid_receive_report(dev_addr, instance);
+void hid_app_remote_key(uint8_t usage, bool pressed)
+{
+  if ( pressed ) keyBitmapSet(&remote_keys, usage); else keyBitmapUnset(&remote_keys, usage);
+  update_keys();
+}
 
-  blink();
+void hid_app_remote_mouse(uint8_t buttons, int8_t x, int8_t y, int8_t wheel)
+{
+  update_mouse(NULL, buttons, x, y, wheel);
 }
 
-// Invoked when device with hid interface is un-mounted
-void tuh_hid_umount_cb(uint8_t dev_addr, uint8_t instance)
+// Remote went away. Let go of whatever it was holding.
+void hid_app_remote_release(void)
 {
-  blink();
+  keyBitmapClear(&remote_keys);
+  update_keys();
+  if ( remote_buttons ) update_mouse(NULL, 0, 0, 0, 0);
 }
 
-// Invoked when received report from device via interrupt endpoint
-void tuh_hid_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t const* report, uint16_t len)
+// Any pad can work the joystick port.
+static void update_joystick(hid_device_t *dev, uint8_t joy)
 {
-  uint8_t const itf_protocol = tuh_hid_interface_protocol(dev_addr, instance);
+  dev->joy = joy;
 
-  switch (itf_protocol)
+  uint8_t all = 0;
+  for ( uint8_t i = 0; i < CFG_TUH_HID; i++ )
   {
-    case HID_ITF_PROTOCOL_KEYBOARD:
-      process_kbd_report( (hid_keyboard_report_t const*) report );
-    break;
-
-    case HID_ITF_PROTOCOL_MOUSE:
-      process_mouse_report( (hid_mouse_report_t const*) report );
-    break;
-
-    default:
-      // Generic report requires matching ReportID and contents with previous parsed report info
-      process_generic_report(dev_addr, instance, report, len);
-    break;
+    if ( hid_devices[i].in_use ) all |= hid_devices[i].joy;
   }
 
-  // continue to request to receive report
-  tuh_hid_receive_report(dev_addr, instance);
+  joystickWrite(all);
+}
+
+void hid_app_task(void)
+{
+  // LED commands are decoded on core1, but only this core may talk to USB.
+  uint8_t leds;
+  if (x68kPortTakeLeds(&leds))
+  {
+    set_leds(leds & 1, (leds >> 1) & 1, (leds >> 2) & 1);
+  }
+
+  // Everything that came in during tuh_task().
+  while ( report_tail != report_head )
+  {
+    process_report(&report_slots[report_tail & (HID_REPORT_SLOTS - 1)]);
+    report_tail++;
+  }
+
+  ctrl_task();
+}
+
+void set_leds(bool numLock, bool capsLock, bool scrollLock) {
+
+  led_want = (numLock ? 1 : 0) + (capsLock ? 2 : 0) + (scrollLock ? 4 : 0);
 
 }
 
 //--------------------------------------------------------------------+
-// Keyboard
+// Control transfers
 //--------------------------------------------------------------------+
 
-// look up new key in previous keys
-static inline bool find_key_in_report(hid_keyboard_report_t const *report, uint8_t keycode)
+static void ctrl_done(void)
 {
-  for(uint8_t i=0; i<6; i++)
+  ctrl_busy = false;
+}
+
+static void set_idle_complete(tuh_xfer_t *xfer)
+{
+  // Plenty of devices stall SET_IDLE. Either way, move on.
+  hid_device_t *dev = &hid_devices[xfer->user_data];
+  if ( dev->in_use && dev->setup_stage == HID_SETUP_IDLE )
   {
-    if (report->keycode[i] == keycode)  return true;
+    dev->setup_stage = dev->wants_boot ? HID_SETUP_PROTOCOL : HID_SETUP_DONE;
   }
-
-  return false;
+  ctrl_done();
 }
 
-static void process_kbd_report(hid_keyboard_report_t const *report)
+static bool send_set_idle(hid_device_t *dev)
 {
-  
-  static hid_keyboard_report_t prev_report = { 0, 0, {0} }; // previous report to check key released
+  tuh_itf_info_t info;
+  if ( !tuh_hid_itf_get_info(dev->dev_addr, dev->instance, &info) ) return false;
 
-  for(uint8_t i=0; i<6; i++)
+  tusb_control_request_t const request =
+  {
+    .bmRequestType = 0x21,   // Class, interface, host to device
+    .bRequest = HID_REQ_CONTROL_SET_IDLE,
+    .wValue = 0,             // Duration 0 (indefinite), all report IDs
+    .wIndex = info.desc.bInterfaceNumber,
+    .wLength = 0
+  };
+
+  tuh_xfer_t xfer =
   {
+    .daddr = dev->dev_addr,
+    .ep_addr = 0,
+    .setup = &request,
+    .buffer = NULL,
+    .complete_cb = set_idle_complete,
+    .user_data = (uintptr_t) (dev - hid_devices)
+  };
+
+  return tuh_control_xfer(&xfer);
+}
 
-    if ( prev_report.keycode[i] ) {
-      if( !find_key_in_report(report, prev_report.keycode[i]) ) {
-        handleKey(prev_report.keycode[i], USBKEY_RELEASED);
-      }
-    }
+// Start the next pending request on one interface, if it has one. One that
+// can't be queued (EP0 busy) is tried again next time round: the stage only
+// moves on from the completion callback, whether the device took it or stalled.
+static bool ctrl_start(hid_device_t *dev)
+{
+  switch ( dev->setup_stage )
+  {
+    case HID_SETUP_IDLE:
+      return send_set_idle(dev);
 
-    if ( report->keycode[i] )
-    {
-      if ( find_key_in_report(&prev_report, report->keycode[i]) )
-      {
-        handleKey(report->keycode[i], USBKEY_HELD);
-      } else {
-        handleKey(report->keycode[i], USBKEY_PRESSED);
-      }
-    }
-    
+    case HID_SETUP_PROTOCOL:
+      return tuh_hid_set_protocol(dev->dev_addr, dev->instance, HID_PROTOCOL_BOOT);
+
+    default: break;
   }
 
-  // Turn the modifiers byte back into scan codes, it's easier this way.
-  for(uint8_t i=0; i<8; i++) {
-    const bool is_pressed = (report->modifier >> i) & 0x01;
-    const bool was_pressed = (prev_report.modifier >> i) & 0x01;
-    const uint8_t this_code = 0xE0 + i;
+  if ( dev->has_leds && dev->led_sent != led_want )
+  {
+    // A keyboard with report IDs wants the ID in wValue and again as the first
+    // byte of the report. Only one without them takes the bare LED byte.
+    uint8_t const report_id = dev->has_plan ? dev->plan.ledReportId : 0;
+    uint8_t len = 0;
+    if ( report_id ) dev->led_buf[len++] = report_id;
+    dev->led_buf[len++] = led_want;
+    return tuh_hid_set_report(dev->dev_addr, dev->instance, report_id, HID_REPORT_TYPE_OUTPUT, dev->led_buf, len);
+  }
 
-    if(!was_pressed && is_pressed) {
-      handleKey(this_code, USBKEY_PRESSED);
-      if(i == 3) setSpecial(true);
-    }
+  return false;
+}
 
-    if(was_pressed && !is_pressed) {
-      handleKey(this_code, USBKEY_RELEASED);
-      if(i == 3) setSpecial(false);
-    }
+// At most one transfer in flight. Interfaces take turns so one busy keyboard
+// can't starve the rest.
+static void ctrl_task(void)
+{
+  static uint8_t next = 0;
+
+  if ( ctrl_busy ) return;
+
+  for ( uint8_t n = 0; n < CFG_TUH_HID; n++ )
+  {
+    hid_device_t *dev = &hid_devices[next];
+    next = (next + 1) % CFG_TUH_HID;
 
-    if(was_pressed && is_pressed) handleKey(this_code, USBKEY_HELD);
+    if ( dev->in_use && ctrl_start(dev) )
+    {
+      ctrl_busy = true;
+      ctrl_addr = dev->dev_addr;
+      return;
+    }
   }
+}
 
-  prev_report = *report;
+void tuh_hid_set_protocol_complete_cb(uint8_t dev_addr, uint8_t instance, uint8_t protocol)
+{
+  hid_device_t *dev = find_device(dev_addr, instance);
+  if ( dev ) dev->setup_stage = HID_SETUP_DONE;
+  ctrl_done();
+}
 
+void tuh_hid_set_report_complete_cb(uint8_t dev_addr, uint8_t instance, uint8_t report_id, uint8_t report_type, uint16_t len)
+{
+  // A keyboard that refuses the report won't do better next time, so count
+  // it as sent either way and wait for the next change.
+  hid_device_t *dev = find_device(dev_addr, instance);
+  if ( dev ) dev->led_sent = dev->led_buf[report_id ? 1 : 0];
+  ctrl_done();
 }
 
 //--------------------------------------------------------------------+
-// Mouse
+// TinyUSB Callbacks
 //--------------------------------------------------------------------+
 
-static void process_mouse_report(hid_mouse_report_t const * report)
+// Invoked when device with hid interface is mounted
+// Report descriptor is also available for use. tuh_hid_parse_report_descriptor()
+// can be used to parse common/simple enough descriptor.
+// Note: if report descriptor length > CFG_TUH_ENUMERATION_BUFSIZE, it will be skipped
+// therefore report_desc = NULL, desc_len = 0
+void tuh_hid_mount_cb(uint8_t dev_addr, uint8_t instance, uint8_t const* desc_report, uint16_t desc_len)
 {
-  uint8_t button_state = 0;
-  if(report->buttons & MOUSE_BUTTON_LEFT) button_state += 1;
-  if(report->buttons & MOUSE_BUTTON_RIGHT) button_state += 2;
-  handleMouse(button_state, report->x, report->y);
+  // Interface protocol (hid_interface_protocol_enum_t)
+  uint8_t const itf_protocol = tuh_hid_interface_protocol(dev_addr, instance);
+
+  recorderMount(dev_addr, instance, itf_protocol, desc_report, desc_len);
+
+  hid_device_t *dev = alloc_device(dev_addr, instance);
+  if ( !dev ) return;
+
+  dev->has_plan = hidPlanCompile(&dev->plan, desc_report, desc_len);
+  dev->has_leds = dev->has_plan ? dev->plan.hasLeds : itf_protocol == HID_ITF_PROTOCOL_KEYBOARD;
+
+  // Descriptor missing (too long for the enumeration buffer) or not understood.
+  // Boot keyboards and mice still have a fixed layout we can fall back on.
+  dev->wants_boot = !dev->has_plan && itf_protocol != HID_ITF_PROTOCOL_NONE;
+
+  // SET_IDLE, SET_PROTOCOL and the current LEDs go out from hid_app_task, one
+  // control transfer at a time. LEDs start off, so only a change is sent.
+  dev->setup_stage = HID_SETUP_IDLE;
+  dev->led_sent = 0;
+
+  tuh_hid_receive_report(dev_addr, instance);
+
+  // Time to first key is measured from here.
+  x68kPortNoteMount();
+  statusLedPlay(&statusLedBlink);
 }
 
-//--------------------------------------------------------------------+
-// Generic Report
-//--------------------------------------------------------------------+
-static void process_generic_report(uint8_t dev_addr, uint8_t instance, uint8_t const* report, uint16_t len)
+// Invoked when device with hid interface is un-mounted
+void tuh_hid_umount_cb(uint8_t dev_addr, uint8_t instance)
 {
-  
-  (void) dev_addr;
+  recorderUnmount(dev_addr, instance);
 
-  uint8_t const rpt_count = hid_info[instance].report_count;
-  tuh_hid_report_info_t* rpt_info_arr = hid_info[instance].report_info;
-  tuh_hid_report_info_t* rpt_info = NULL;
+  hid_device_t *dev = find_device(dev_addr, instance);
 
-  if ( rpt_count == 1 && rpt_info_arr[0].report_id == 0)
+  if ( dev )
   {
-    // Simple report without report ID as 1st byte
-    rpt_info = &rpt_info_arr[0];
-  }else
-  {
-    // Composite report, 1st byte is report ID, data starts from 2nd byte
-    uint8_t const rpt_id = report[0];
+    // Let go of anything it was holding before forgetting it.
+    bool const had_buttons = dev->buttons;
+    bool const had_joy = dev->joy;
+
+    dev->in_use = false;
+    hid_slot[dev_addr][instance] = 0;
 
-    // Find report id in the array
-    for(uint8_t i=0; i<rpt_count; i++)
+    // Anything it sent that hasn't been handled yet goes with it.
+    for ( uint16_t i = report_tail; i != report_head; i++ )
     {
-      if (rpt_id == rpt_info_arr[i].report_id )
-      {
-        rpt_info = &rpt_info_arr[i];
-        break;
-      }
+      hid_report_slot_t *slot = &report_slots[i & (HID_REPORT_SLOTS - 1)];
+      if ( slot->dev_addr == dev_addr && slot->instance == instance ) slot->dev_addr = 0;
     }
 
-    report++;
-    len--;
+    // Its transfer won't be completing now.
+    if ( ctrl_busy && ctrl_addr == dev_addr ) ctrl_done();
+    keyBitmapClear(&dev->keys);
+    dev->consumer_key = 0;
+    dev->buttons = 0;
+    dev->joy = 0;
+
+    update_keys();
+    if ( had_buttons ) update_mouse(dev, 0, 0, 0, 0);
+    if ( had_joy ) update_joystick(dev, 0);
   }
 
-  if (!rpt_info)
+  statusLedPlay(&statusLedLittleBlink);
+}
+
+// Invoked when received report from device via interrupt endpoint
+void tuh_hid_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t const* report, uint16_t len)
+{
+  uint64_t const arrival = statNow();
+  statCount(STAT_EVT_REPORTS);
+  recorderHidReport(dev_addr, instance, report, len);
+
+  hid_device_t *dev = find_device(dev_addr, instance);
+  if ( dev ) note_report_rate(dev);
+
+  // Full means the main loop has fallen a long way behind. Handle the oldest
+  // now rather than lose a key going up.
+  if ( (uint16_t)(report_head - report_tail) == HID_REPORT_SLOTS )
   {
-    return;
+    process_report(&report_slots[report_tail & (HID_REPORT_SLOTS - 1)]);
+    report_tail++;
+    statCount(STAT_EVT_REPORT_OVERFLOWS);
   }
 
-  // For complete list of Usage Page & Usage checkout src/class/hid/hid.h. For examples:
-  // - Keyboard                     : Desktop, Keyboard
-  // - Mouse                        : Desktop, Mouse
-  // - Gamepad                      : Desktop, Gamepad
-  // - Consumer Control (Media Key) : Consumer, Consumer Control
-  // - System Control (Power key)   : Desktop, System Control
-  // - Generic (vendor)             : 0xFFxx, xx
-  if ( rpt_info->usage_page == HID_USAGE_PAGE_DESKTOP )
+  hid_report_slot_t *slot = &report_slots[report_head & (HID_REPORT_SLOTS - 1)];
+  if ( len > sizeof(slot->data) ) len = sizeof(slot->data);
+  slot->arrival = arrival;
+  slot->dev_addr = dev_addr;
+  slot->instance = instance;
+  slot->len = len;
+  memcpy(slot->data, report, len);
+  report_head++;
+
+  uint16_t const depth = report_head - report_tail;
+  if ( depth > statEvents[STAT_EVT_REPORT_QUEUE_HIGH] ) statEvents[STAT_EVT_REPORT_QUEUE_HIGH] = depth;
+
+  // continue to request to receive report
+  tuh_hid_receive_report(dev_addr, instance);
+}
+
+// Reports per second, per interface, over one second windows. A 1000 Hz mouse
+// that's keeping up shows as 1000 here.
+static void note_report_rate(hid_device_t *dev)
+{
+  uint32_t const now = to_ms_since_boot(get_absolute_time());
+  uint32_t const elapsed = now - dev->rate_start;
+
+  if ( elapsed >= 1000 )
   {
-    switch (rpt_info->usage)
+    // Only a window with traffic all the way through says anything about the rate.
+    if ( elapsed < 1100 )
     {
-      case HID_USAGE_DESKTOP_KEYBOARD:
-        // Assume keyboard follow boot report layout
-        process_kbd_report( (hid_keyboard_report_t const*) report );
+      uint32_t const hz = dev->rate_count * 1000 / elapsed;
+      if ( hz > statEvents[STAT_EVT_REPORT_HZ] ) statEvents[STAT_EVT_REPORT_HZ] = hz;
+    }
+    dev->rate_start = now;
+    dev->rate_count = 0;
+  }
+
+  dev->rate_count++;
+}
+
+static void process_report(hid_report_slot_t const *slot)
+{
+  uint64_t const start = slot->arrival;
+  uint8_t const *report = slot->data;
+  uint16_t const len = slot->len;
+
+  hid_device_t *dev = slot->dev_addr ? find_device(slot->dev_addr, slot->instance) : NULL;
+  hidInput_t in;
+
+  if ( !dev )
+  {
+    // Not ours, no room for it, or gone since.
+  }
+  else if ( dev->has_plan )
+  {
+    if ( hidPlanRun(&dev->plan, report, len, &in) )
+    {
+      bool keys_changed = false;
+
+      if ( in.hasKeys )
+      {
+        dev->keys = in.keys;
+        keys_changed = true;
+      }
+
+      if ( in.hasConsumer && in.consumerKey != dev->consumer_key )
+      {
+        dev->consumer_key = in.consumerKey;
+        keys_changed = true;
+      }
+
+      // Pads first, they're the ones in a hurry.
+      if ( in.hasPad )
+      {
+        update_joystick(dev, joystickFromPad(in.padButtons, in.padX, in.padY, in.padHat));
+        statSince(STAT_PAD, start);
+      }
+
+      if ( keys_changed ) update_keys();
+      if ( in.hasMouse ) update_mouse(dev, in.buttons, in.x, in.y, in.wheel);
+    }
+  }
+  else if ( tuh_hid_get_protocol(dev->dev_addr, dev->instance) == HID_PROTOCOL_BOOT )
+  {
+    switch ( tuh_hid_interface_protocol(dev->dev_addr, dev->instance) )
+    {
+      case HID_ITF_PROTOCOL_KEYBOARD:
+        process_kbd_report( dev, (hid_keyboard_report_t const*) report );
       break;
 
-      case HID_USAGE_DESKTOP_MOUSE:
-        // Assume mouse follow boot report layout
-        process_mouse_report( (hid_mouse_report_t const*) report );
+      case HID_ITF_PROTOCOL_MOUSE:
+        process_mouse_report( dev, (hid_mouse_report_t const*) report, len );
       break;
 
       default: break;
     }
   }
 
+  statSince(STAT_REPORT, start);
+}
+
+//--------------------------------------------------------------------+
+// Keyboard
+//--------------------------------------------------------------------+
+
+static void process_kbd_report(hid_device_t *dev, hid_keyboard_report_t const *report)
+{
+  keyBitmap_t keys;
+
+  // ErrorRollOver means "too many keys", not "everything released", so hold the last state.
+  if ( keyBitmapFromBoot(&keys, report) )
+  {
+    dev->keys = keys;
+    update_keys();
+  }
+}
+
+//--------------------------------------------------------------------+
+// Mouse
+//--------------------------------------------------------------------+
+
+static void process_mouse_report(hid_device_t *dev, hid_mouse_report_t const * report, uint16_t len)
+{
+  uint8_t button_state = 0;
+  if(report->buttons & MOUSE_BUTTON_LEFT) button_state |= MOUSE_X68_LEFT;
+  if(report->buttons & MOUSE_BUTTON_RIGHT) button_state |= MOUSE_X68_RIGHT;
+  if(report->buttons & MOUSE_BUTTON_MIDDLE) button_state |= MOUSE_X68_MIDDLE;
+
+  // The boot mouse report is only 3 bytes, the wheel is an extra some mice add.
+  update_mouse(dev, button_state, report->x, report->y, len > 3 ? report->wheel : 0);
 }
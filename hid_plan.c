@@ -0,0 +1,435 @@
+// Report protocol HID support.
+//
+// Boot protocol limits us to 8 bit mouse deltas and 6 keys, and the old
+// generic path just cast whatever arrived to a boot report. Here the report
+// descriptor is walked once at mount, and only the fields we care about are
+// kept: keyboard bitfields and arrays, mouse buttons/X/Y/wheel, gamepad
+// buttons/X/Y/hat and consumer control arrays.
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "tusb.h"
+#include "hid_plan.h"
+#include "keystate.h"
+
+// Short item prefix: tag in the top nibble, type in bits 2-3, size in bits 0-1.
+#define ITEM_TYPE_MAIN   0
+#define ITEM_TYPE_GLOBAL 1
+#define ITEM_TYPE_LOCAL  2
+#define ITEM_LONG        0xFE
+
+#define MAIN_INPUT          0x8
+#define MAIN_OUTPUT         0x9
+#define MAIN_COLLECTION     0xA
+#define MAIN_END_COLLECTION 0xC
+
+#define GLOBAL_USAGE_PAGE   0x0
+#define GLOBAL_LOGICAL_MIN  0x1
+#define GLOBAL_LOGICAL_MAX  0x2
+#define GLOBAL_REPORT_SIZE  0x7
+#define GLOBAL_REPORT_ID    0x8
+#define GLOBAL_REPORT_COUNT 0x9
+#define GLOBAL_PUSH         0xA
+#define GLOBAL_POP          0xB
+
+#define LOCAL_USAGE         0x0
+#define LOCAL_USAGE_MIN     0x1
+#define LOCAL_USAGE_MAX     0x2
+
+#define INPUT_CONSTANT 0x01
+#define INPUT_VARIABLE 0x02
+
+#define MAX_LOCAL_USAGES 16
+
+#define USAGE_ERROR_ROLLOVER 0x01
+
+typedef struct {
+    uint16_t usagePage;
+    int32_t logicalMin;
+    uint32_t logicalMax;        // Raw, its sign depends on logicalMin
+    int32_t logicalMaxSigned;
+    uint16_t reportSize;
+    uint16_t reportCount;       // NKRO bitmaps and padding run past 255
+    uint8_t reportId;
+} globalState_t;
+
+typedef struct {
+    uint32_t usages[MAX_LOCAL_USAGES];
+    uint8_t usageCount;
+    uint32_t usageMin, usageMax;
+    bool hasRange;
+} localState_t;
+
+// Consumer controls that have an obvious keyboard equivalent. The keyboard
+// usage then goes through the normal layout like any other key.
+static const struct {
+    uint16_t consumer;
+    uint8_t keyboard;
+} consumerKeys[] = {
+    { 0x00B5, 0x4E },   // Scan Next Track -> Page Down (ROLL DOWN)
+    { 0x00B6, 0x4B },   // Scan Previous Track -> Page Up (ROLL UP)
+    { 0x0223, 0x4A },   // AC Home -> Home
+    { 0x0224, 0x29 },   // AC Back -> Escape
+};
+
+//--------------------------------------------------------------------+
+// Compile
+//--------------------------------------------------------------------+
+
+static hidReportPlan_t *findReport(hidPlan_t *plan, uint8_t reportId) {
+    for(uint8_t i = 0; i < plan->reportCount; i++) {
+        if(plan->reports[i].reportId == reportId) return &plan->reports[i];
+    }
+
+    if(plan->reportCount == HID_PLAN_MAX_REPORTS) return NULL;
+
+    hidReportPlan_t *r = &plan->reports[plan->reportCount++];
+    r->reportId = reportId;
+    return r;
+}
+
+static hidField_t *addField(hidReportPlan_t *r, uint8_t kind, uint16_t bitOffset, uint16_t bitSize, uint16_t count, uint8_t firstUsage, bool isSigned) {
+    if(r->fieldCount == HID_PLAN_MAX_FIELDS) return NULL;
+    if(bitSize == 0 || bitSize > 32) return NULL;
+
+    hidField_t *f = &r->fields[r->fieldCount++];
+    f->bitOffset = bitOffset;
+    f->bitSize = bitSize;
+    f->count = count;
+    f->kind = kind;
+    f->firstUsage = firstUsage;
+    f->isSigned = isSigned;
+    return f;
+}
+
+// Gamepad axes and hats need to know their range to find the middle.
+static void addRangedField(hidReportPlan_t *r, uint8_t kind, uint16_t bitOffset, uint16_t bitSize, const globalState_t *global) {
+    hidField_t *f = addField(r, kind, bitOffset, bitSize, 1, 0, global->logicalMin < 0);
+    if(!f) return;
+
+    f->logicalMin = global->logicalMin;
+    f->logicalMax = global->logicalMin < 0 ? global->logicalMaxSigned : (int32_t)global->logicalMax;
+}
+
+// Usage (page << 16 | id) of the n'th control in a main item.
+static uint32_t localUsage(const localState_t *local, uint16_t n) {
+    if(local->usageCount) return local->usages[n < local->usageCount ? n : local->usageCount - 1];
+    if(local->hasRange) {
+        const uint32_t u = local->usageMin + n;
+        return u > local->usageMax ? local->usageMax : u;
+    }
+    return 0;
+}
+
+static void addInput(hidPlan_t *plan, const globalState_t *global, const localState_t *local, uint32_t flags, uint32_t appUsage) {
+    hidReportPlan_t *r = findReport(plan, global->reportId);
+    if(!r) return;
+
+    const uint16_t size = global->reportSize;
+    const uint16_t count = global->reportCount;
+    const uint16_t offset = r->bitLength;
+    r->bitLength += size * count;
+
+    if(flags & INPUT_CONSTANT) return;
+
+    const uint32_t first = localUsage(local, 0);
+    const uint16_t page = first >> 16;
+    const uint16_t id = first & 0xFFFF;
+    const bool isSigned = global->logicalMin < 0;
+    const bool isMouse = appUsage == ((HID_USAGE_PAGE_DESKTOP << 16) | HID_USAGE_DESKTOP_MOUSE);
+    const bool isPad = appUsage == ((HID_USAGE_PAGE_DESKTOP << 16) | HID_USAGE_DESKTOP_GAMEPAD) ||
+                       appUsage == ((HID_USAGE_PAGE_DESKTOP << 16) | HID_USAGE_DESKTOP_JOYSTICK);
+
+    if(!(flags & INPUT_VARIABLE)) {
+        if(page == HID_USAGE_PAGE_KEYBOARD) addField(r, HID_FIELD_KEY_ARRAY, offset, size, count, 0, false);
+        if(page == HID_USAGE_PAGE_CONSUMER) addField(r, HID_FIELD_CONSUMER, offset, size, count, 0, false);
+        return;
+    }
+
+    if(page == HID_USAGE_PAGE_KEYBOARD && size == 1 && id <= 0xFF) {
+        addField(r, HID_FIELD_KEY_BITS, offset, 1, count, id, false);
+        return;
+    }
+
+    if(page == HID_USAGE_PAGE_BUTTON && size == 1 && isMouse && id >= 1) {
+        addField(r, HID_FIELD_BUTTONS, offset, 1, count, id, false);
+        return;
+    }
+
+    if(page == HID_USAGE_PAGE_BUTTON && size == 1 && isPad && id >= 1) {
+        addField(r, HID_FIELD_PAD_BUTTONS, offset, 1, count, id, false);
+        return;
+    }
+
+    if(isPad) {
+        for(uint16_t i = 0; i < count; i++) {
+            const uint32_t usage = localUsage(local, i);
+            if((usage >> 16) != HID_USAGE_PAGE_DESKTOP) continue;
+
+            switch(usage & 0xFFFF) {
+                case HID_USAGE_DESKTOP_X:          addRangedField(r, HID_FIELD_PAD_X, offset + i * size, size, global); break;
+                case HID_USAGE_DESKTOP_Y:          addRangedField(r, HID_FIELD_PAD_Y, offset + i * size, size, global); break;
+                case HID_USAGE_DESKTOP_HAT_SWITCH: addRangedField(r, HID_FIELD_PAD_HAT, offset + i * size, size, global); break;
+                default: break;
+            }
+        }
+        return;
+    }
+
+    if(!isMouse) return;
+
+    for(uint16_t i = 0; i < count; i++) {
+        const uint32_t usage = localUsage(local, i);
+        if((usage >> 16) != HID_USAGE_PAGE_DESKTOP) continue;
+
+        switch(usage & 0xFFFF) {
+            case HID_USAGE_DESKTOP_X:
+                addField(r, HID_FIELD_X, offset + i * size, size, 1, 0, isSigned);
+            break;
+            case HID_USAGE_DESKTOP_Y:
+                addField(r, HID_FIELD_Y, offset + i * size, size, 1, 0, isSigned);
+            break;
+            case HID_USAGE_DESKTOP_WHEEL:
+                addField(r, HID_FIELD_WHEEL, offset + i * size, size, 1, 0, isSigned);
+            break;
+            default: break;
+        }
+    }
+}
+
+bool hidPlanCompile(hidPlan_t *plan, uint8_t const *desc, uint16_t len) {
+    globalState_t global = { 0 }, pushed = { 0 };
+    localState_t local = { 0 };
+    uint32_t appUsage = 0;
+    uint8_t depth = 0;
+    uint16_t pos = 0;
+
+    memset(plan, 0, sizeof(*plan));
+    if(!desc) return false;
+
+    while(pos < len) {
+        const uint8_t prefix = desc[pos++];
+
+        if(prefix == ITEM_LONG) {
+            if(pos + 1 >= len) break;
+            pos += 2 + desc[pos];
+            continue;
+        }
+
+        uint8_t size = prefix & 0x03;
+        if(size == 3) size = 4;
+        if(pos + size > len) break;
+
+        uint32_t data = 0;
+        for(uint8_t i = 0; i < size; i++) data |= (uint32_t)desc[pos + i] << (8 * i);
+        pos += size;
+
+        int32_t sdata = (int32_t)data;
+        if(size == 1) sdata = (int8_t)data;
+        if(size == 2) sdata = (int16_t)data;
+
+        const uint8_t tag = prefix >> 4;
+
+        switch((prefix >> 2) & 0x03) {
+            case ITEM_TYPE_GLOBAL:
+                switch(tag) {
+                    case GLOBAL_USAGE_PAGE:   global.usagePage = data; break;
+                    case GLOBAL_LOGICAL_MIN:  global.logicalMin = sdata; break;
+                    case GLOBAL_LOGICAL_MAX:  global.logicalMax = data; global.logicalMaxSigned = sdata; break;
+                    case GLOBAL_REPORT_SIZE:  global.reportSize = data; break;
+                    case GLOBAL_REPORT_COUNT: global.reportCount = data; break;
+                    case GLOBAL_REPORT_ID:
+                        global.reportId = data;
+                        plan->usesReportIds = true;
+                    break;
+                    case GLOBAL_PUSH: pushed = global; break;
+                    case GLOBAL_POP:  global = pushed; break;
+                    default: break;
+                }
+            break;
+
+            case ITEM_TYPE_LOCAL: {
+                // 4 byte usages carry their own page.
+                const uint32_t usage = size == 4 ? data : ((uint32_t)global.usagePage << 16) | data;
+                switch(tag) {
+                    case LOCAL_USAGE:
+                        if(local.usageCount < MAX_LOCAL_USAGES) local.usages[local.usageCount++] = usage;
+                    break;
+                    case LOCAL_USAGE_MIN: local.usageMin = usage; local.hasRange = true; break;
+                    case LOCAL_USAGE_MAX: local.usageMax = usage; break;
+                    default: break;
+                }
+            }
+            break;
+
+            case ITEM_TYPE_MAIN:
+                switch(tag) {
+                    case MAIN_COLLECTION:
+                        if(depth++ == 0) appUsage = localUsage(&local, 0);
+                    break;
+                    case MAIN_END_COLLECTION:
+                        if(depth) depth--;
+                    break;
+                    case MAIN_INPUT:
+                        addInput(plan, &global, &local, data, appUsage);
+                    break;
+                    case MAIN_OUTPUT:
+                        if(global.usagePage == HID_USAGE_PAGE_LED && !plan->hasLeds) {
+                            plan->hasLeds = true;
+                            plan->ledReportId = global.reportId;
+                        }
+                    break;
+                    default: break;
+                }
+                memset(&local, 0, sizeof(local));
+            break;
+
+            default: break;
+        }
+    }
+
+    for(uint8_t i = 0; i < plan->reportCount; i++) {
+        if(plan->reports[i].fieldCount) return true;
+    }
+    return false;
+}
+
+//--------------------------------------------------------------------+
+// Run
+//--------------------------------------------------------------------+
+
+static uint32_t extractBits(uint8_t const *data, uint16_t len, uint16_t bitOffset, uint8_t bitSize) {
+    const uint16_t first = bitOffset >> 3;
+    const uint8_t shift = bitOffset & 7;
+    const uint8_t bytes = (shift + bitSize + 7) >> 3;
+    uint64_t raw = 0;
+
+    for(uint8_t i = 0; i < bytes && first + i < len; i++) raw |= (uint64_t)data[first + i] << (8 * i);
+
+    raw >>= shift;
+    return bitSize == 32 ? (uint32_t)raw : (uint32_t)raw & ((1u << bitSize) - 1);
+}
+
+static int32_t extractSigned(uint8_t const *data, uint16_t len, const hidField_t *f) {
+    const uint32_t v = extractBits(data, len, f->bitOffset, f->bitSize);
+    if(!f->isSigned || f->bitSize == 32) return (int32_t)v;
+
+    const uint32_t sign = 1u << (f->bitSize - 1);
+    return (int32_t)((v ^ sign) - sign);
+}
+
+static int16_t clampAxis(int32_t v) {
+    return v > INT16_MAX ? INT16_MAX : (v < INT16_MIN ? INT16_MIN : v);
+}
+
+// Scale a pad axis to -127..127 around the middle of its range.
+static int8_t padAxis(uint8_t const *data, uint16_t len, const hidField_t *f) {
+    const int32_t v = extractSigned(data, len, f);
+    const int32_t range = f->logicalMax - f->logicalMin;
+    if(range <= 0) return 0;
+
+    int32_t n = (v - f->logicalMin) * 254 / range - 127;
+    return n > 127 ? 127 : (n < -127 ? -127 : n);
+}
+
+// Hat positions run clockwise from north. Anything else is centred.
+static uint8_t padHat(uint8_t const *data, uint16_t len, const hidField_t *f) {
+    static const uint8_t hatDirections[8] = {
+        HID_PAD_UP, HID_PAD_UP | HID_PAD_RIGHT, HID_PAD_RIGHT, HID_PAD_DOWN | HID_PAD_RIGHT,
+        HID_PAD_DOWN, HID_PAD_DOWN | HID_PAD_LEFT, HID_PAD_LEFT, HID_PAD_UP | HID_PAD_LEFT
+    };
+
+    const int32_t v = extractSigned(data, len, f) - f->logicalMin;
+    return v >= 0 && v < 8 ? hatDirections[v] : 0;
+}
+
+static uint8_t consumerToKey(uint16_t usage) {
+    for(uint8_t i = 0; i < TU_ARRAY_SIZE(consumerKeys); i++) {
+        if(consumerKeys[i].consumer == usage) return consumerKeys[i].keyboard;
+    }
+    return 0;
+}
+
+bool hidPlanRun(const hidPlan_t *plan, uint8_t const *report, uint16_t len, hidInput_t *in) {
+    const hidReportPlan_t *r = NULL;
+
+    if(plan->usesReportIds) {
+        if(len < 1) return false;
+        const uint8_t reportId = *report++;
+        len--;
+        for(uint8_t i = 0; i < plan->reportCount; i++) {
+            if(plan->reports[i].reportId == reportId) r = &plan->reports[i];
+        }
+    }else{
+        r = &plan->reports[0];
+    }
+
+    if(!r || !r->fieldCount) return false;
+
+    bool keysValid = true;
+    int32_t x = 0, y = 0, wheel = 0;
+
+    memset(in, 0, sizeof(*in));
+
+    for(uint8_t i = 0; i < r->fieldCount; i++) {
+        const hidField_t *f = &r->fields[i];
+
+        switch(f->kind) {
+            case HID_FIELD_KEY_BITS:
+                in->hasKeys = true;
+                for(uint16_t bit = 0; bit < f->count; bit += 32) {
+                    const uint8_t n = f->count - bit < 32 ? f->count - bit : 32;
+                    keyBitmapAddBits(&in->keys, f->firstUsage + bit, extractBits(report, len, f->bitOffset + bit, n), n);
+                }
+            break;
+
+            case HID_FIELD_KEY_ARRAY:
+                in->hasKeys = true;
+                for(uint16_t n = 0; n < f->count; n++) {
+                    const uint32_t usage = extractBits(report, len, f->bitOffset + n * f->bitSize, f->bitSize);
+                    if(usage == USAGE_ERROR_ROLLOVER) keysValid = false;
+                    if(usage >= 4 && usage <= 0xFF) keyBitmapSet(&in->keys, usage);
+                }
+            break;
+
+            case HID_FIELD_BUTTONS:
+                in->hasMouse = true;
+                // Buttons 1-3 line up with the MOUSE_X68_ bits.
+                in->buttons = (extractBits(report, len, f->bitOffset, f->count < 8 ? f->count : 8) << (f->firstUsage - 1)) & 0x07;
+            break;
+
+            case HID_FIELD_X:     in->hasMouse = true; x = extractSigned(report, len, f); break;
+            case HID_FIELD_Y:     in->hasMouse = true; y = extractSigned(report, len, f); break;
+            case HID_FIELD_WHEEL: in->hasMouse = true; wheel = extractSigned(report, len, f); break;
+
+            case HID_FIELD_PAD_BUTTONS:
+                in->hasPad = true;
+                in->padButtons = extractBits(report, len, f->bitOffset, f->count < 16 ? f->count : 16) << (f->firstUsage - 1);
+            break;
+
+            case HID_FIELD_PAD_X:   in->hasPad = true; in->padX = padAxis(report, len, f); break;
+            case HID_FIELD_PAD_Y:   in->hasPad = true; in->padY = padAxis(report, len, f); break;
+            case HID_FIELD_PAD_HAT: in->hasPad = true; in->padHat = padHat(report, len, f); break;
+
+            case HID_FIELD_CONSUMER:
+                in->hasConsumer = true;
+                for(uint16_t n = 0; n < f->count && !in->consumerKey; n++) {
+                    in->consumerKey = consumerToKey(extractBits(report, len, f->bitOffset + n * f->bitSize, f->bitSize));
+                }
+            break;
+
+            default: break;
+        }
+    }
+
+    // ErrorRollOver says nothing about which keys are down.
+    if(!keysValid) in->hasKeys = false;
+
+    if(wheel > INT8_MAX) wheel = INT8_MAX;
+    if(wheel < INT8_MIN) wheel = INT8_MIN;
+    in->x = clampAxis(x);
+    in->y = clampAxis(y);
+    in->wheel = wheel;
+
+    return in->hasKeys || in->hasMouse || in->hasConsumer || in->hasPad;
+}
@@ -0,0 +1,86 @@
+// Report protocol HID support.
+//
+// At mount time the report descriptor is compiled into a short list of fields
+// per report ID (where the bits are, how wide, what they mean). Each incoming
+// report then just runs that list, with no descriptor parsing on the hot path.
+
+#ifndef _HID_PLAN_H_INCLUDED
+#define _HID_PLAN_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "keystate.h"
+
+#define HID_PLAN_MAX_REPORTS 4
+#define HID_PLAN_MAX_FIELDS  8
+
+typedef enum {
+    HID_FIELD_KEY_BITS,     // One bit per keyboard usage from firstUsage (modifiers, NKRO)
+    HID_FIELD_KEY_ARRAY,    // count slots, each holding a keyboard usage (6KRO)
+    HID_FIELD_BUTTONS,      // One bit per mouse button from button firstUsage
+    HID_FIELD_X,
+    HID_FIELD_Y,
+    HID_FIELD_WHEEL,
+    HID_FIELD_CONSUMER,     // count slots, each holding a consumer usage
+    HID_FIELD_PAD_BUTTONS,  // One bit per gamepad button from button firstUsage
+    HID_FIELD_PAD_X,
+    HID_FIELD_PAD_Y,
+    HID_FIELD_PAD_HAT,
+} hidFieldKind_t;
+
+// Digital directions, as reported in hidInput_t.padHat.
+#define HID_PAD_UP    0x01
+#define HID_PAD_DOWN  0x02
+#define HID_PAD_LEFT  0x04
+#define HID_PAD_RIGHT 0x08
+
+typedef struct {
+    uint16_t bitOffset;     // From the first byte after the report ID
+    uint8_t bitSize;
+    uint16_t count;
+    uint8_t kind;
+    uint8_t firstUsage;
+    bool isSigned;
+    int32_t logicalMin;     // Pad axes and hats only
+    int32_t logicalMax;
+} hidField_t;
+
+typedef struct {
+    uint8_t reportId;
+    uint8_t fieldCount;
+    uint16_t bitLength;
+    hidField_t fields[HID_PLAN_MAX_FIELDS];
+} hidReportPlan_t;
+
+typedef struct {
+    uint8_t reportCount;
+    bool usesReportIds;
+    bool hasLeds;
+    uint8_t ledReportId;    // Output report carrying the keyboard LEDs
+    hidReportPlan_t reports[HID_PLAN_MAX_REPORTS];
+} hidPlan_t;
+
+// False if the descriptor has nothing we know how to use.
+bool hidPlanCompile(hidPlan_t *plan, uint8_t const *desc, uint16_t len);
+
+// What one report said. Each part is only filled in if the report carried it.
+typedef struct {
+    bool hasKeys;           // Cleared on ErrorRollOver too
+    bool hasMouse;
+    bool hasConsumer;
+    bool hasPad;
+    keyBitmap_t keys;
+    uint8_t buttons;        // MOUSE_X68_ bits
+    int16_t x, y;
+    int8_t wheel;
+    uint8_t consumerKey;    // Keyboard usage standing in for a consumer control, or 0
+    uint16_t padButtons;    // Bit n is button n + 1
+    int8_t padX, padY;      // -127..127, 0 centred
+    uint8_t padHat;         // HID_PAD_ bits
+} hidInput_t;
+
+// Extract one report. The caller decides what to do with it, since several
+// devices may be feeding the same X68000. False if nothing in it was useful.
+bool hidPlanRun(const hidPlan_t *plan, uint8_t const *report, uint16_t len, hidInput_t *in);
+
+#endif
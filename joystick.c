@@ -0,0 +1,66 @@
+// X68000 joystick port, driven from USB gamepads.
+//
+// The port is six active low lines (four directions, two triggers). Every
+// combination of them has its GPIO pattern worked out once at start-up, so a
+// report turns into pins with a table lookup and one write to the SIO toggle
+// register. That happens in hid_app_task() as each queued report is handled,
+// before the rest of the report.
+
+#include "pico/stdlib.h"
+#include "joystick.h"
+#include "hid_plan.h"
+
+static const uint8_t joyPins[6] = { JOY_PIN_UP, JOY_PIN_DOWN, JOY_PIN_LEFT, JOY_PIN_RIGHT, JOY_PIN_A, JOY_PIN_B };
+
+static uint32_t joyPinMask = 0;
+static uint32_t joyOutput[JOY_STATES];
+static uint8_t joyDeadzone = JOY_DEADZONE_DEFAULT;
+
+void joystickInit(void) {
+    joyPinMask = 0;
+    for(uint8_t i = 0; i < count_of(joyPins); i++) joyPinMask |= 1u << joyPins[i];
+
+    // Active low: every line high except the ones that are pressed.
+    for(uint8_t state = 0; state < JOY_STATES; state++) {
+        uint32_t out = joyPinMask;
+        for(uint8_t i = 0; i < count_of(joyPins); i++) {
+            if(state & (1 << i)) out &= ~(1u << joyPins[i]);
+        }
+        joyOutput[state] = out;
+    }
+
+    gpio_init_mask(joyPinMask);
+    gpio_put_masked(joyPinMask, joyOutput[0]);
+    gpio_set_dir_out_masked(joyPinMask);
+}
+
+void joystickSetDeadzone(uint8_t deadzone) {
+    joyDeadzone = deadzone > 126 ? 126 : deadzone;
+}
+
+uint8_t joystickFromPad(uint16_t buttons, int8_t x, int8_t y, uint8_t hat) {
+    uint8_t state = 0;
+
+    if(hat & HID_PAD_UP)    state |= JOY_UP;
+    if(hat & HID_PAD_DOWN)  state |= JOY_DOWN;
+    if(hat & HID_PAD_LEFT)  state |= JOY_LEFT;
+    if(hat & HID_PAD_RIGHT) state |= JOY_RIGHT;
+
+    if(y < -joyDeadzone) state |= JOY_UP;
+    if(y >  joyDeadzone) state |= JOY_DOWN;
+    if(x < -joyDeadzone) state |= JOY_LEFT;
+    if(x >  joyDeadzone) state |= JOY_RIGHT;
+
+    // A real stick can't do both at once, and some games get upset if it does.
+    if((state & (JOY_UP | JOY_DOWN)) == (JOY_UP | JOY_DOWN)) state &= ~(JOY_UP | JOY_DOWN);
+    if((state & (JOY_LEFT | JOY_RIGHT)) == (JOY_LEFT | JOY_RIGHT)) state &= ~(JOY_LEFT | JOY_RIGHT);
+
+    if(buttons & JOY_BUTTONS_A) state |= JOY_A;
+    if(buttons & JOY_BUTTONS_B) state |= JOY_B;
+
+    return state;
+}
+
+void joystickWrite(uint8_t state) {
+    gpio_put_masked(joyPinMask, joyOutput[state & (JOY_STATES - 1)]);
+}
@@ -0,0 +1,42 @@
+// X68000 joystick port, driven from USB gamepads.
+
+#ifndef _JOYSTICK_H_INCLUDED
+#define _JOYSTICK_H_INCLUDED
+
+#include <stdint.h>
+
+// One GPIO per joystick line, each through an open collector buffer (7407
+// or similar) to the DE-9, so a low GPIO pulls the X68000's line low.
+#define JOY_PIN_UP    6     // DE-9 pin 1
+#define JOY_PIN_DOWN  7     // 2
+#define JOY_PIN_LEFT  8     // 3
+#define JOY_PIN_RIGHT 9     // 4
+#define JOY_PIN_A     10    // 6
+#define JOY_PIN_B     11    // 7
+
+// Joystick state bits, the index into the output table.
+#define JOY_UP    0x01
+#define JOY_DOWN  0x02
+#define JOY_LEFT  0x04
+#define JOY_RIGHT 0x08
+#define JOY_A     0x10
+#define JOY_B     0x20
+#define JOY_STATES 64
+
+// Pad buttons (bit n is button n + 1) that count as each trigger.
+#define JOY_BUTTONS_A 0x0005
+#define JOY_BUTTONS_B 0x000A
+
+// How far a stick has to move (of 127) before it counts as a direction.
+#define JOY_DEADZONE_DEFAULT 48
+
+void joystickInit(void);
+void joystickSetDeadzone(uint8_t deadzone);
+
+// Fold one pad report into JOY_ bits.
+uint8_t joystickFromPad(uint16_t buttons, int8_t x, int8_t y, uint8_t hat);
+
+// Drive the port. A single register write.
+void joystickWrite(uint8_t state);
+
+#endif
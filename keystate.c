@@ -0,0 +1,131 @@
+// Pressed-key state as a 256 bit bitmap indexed by USB usage.
+//
+// A new report is turned into a bitmap and XORed against the current one a
+// word at a time, so only real transitions reach handleKey. Held keys cost
+// nothing, and bitmap (NKRO) reports work the same as boot reports.
+//
+// Debounce is eager: a key's first edge goes straight through, and any edge
+// in the window after it is held back, so a chattering switch can't double
+// a character but a clean one isn't slowed down at all. Whatever the key is
+// actually doing when its window closes is applied then, so a quick tap
+// can't get stuck down.
+
+#include "pico/stdlib.h"
+#include "keystate.h"
+#include "PicoX68Key.h"
+#include "stats.h"
+
+#define USAGE_ERROR_ROLLOVER 0x01
+#define USAGE_FIRST_KEY      0x04
+
+static keyBitmap_t keyState = { { 0 } };
+
+// Latest report as it came in, and which keys are waiting on their window.
+static keyBitmap_t rawState = { { 0 } };
+static bool held = false;
+static bool suppressed;
+
+static uint8_t debounceMs = KEY_DEBOUNCE_MS_DEFAULT;
+static uint16_t lastEdgeMs[256];    // Wraps every 65s, which only risks one late edge
+
+uint16_t keyChatter[256];
+
+bool keyBitmapFromBoot(keyBitmap_t *keys, hid_keyboard_report_t const *report) {
+    keyBitmapClear(keys);
+
+    for(uint8_t i = 0; i < 6; i++) {
+        const uint8_t keycode = report->keycode[i];
+        if(keycode == USAGE_ERROR_ROLLOVER) return false;
+        if(keycode >= USAGE_FIRST_KEY) keyBitmapSet(keys, keycode);
+    }
+
+    keys->w[KEY_BITMAP_WORDS - 1] |= report->modifier;
+    return true;
+}
+
+void keyBitmapAddBits(keyBitmap_t *keys, uint16_t firstUsage, uint32_t bits, uint8_t bitCount) {
+    if(bitCount < 32) bits &= (1u << bitCount) - 1;
+
+    while(bits) {
+        const uint16_t usage = firstUsage + __builtin_ctz(bits);
+        bits &= bits - 1;
+        if(usage > 0xFF) break;
+        keyBitmapSet(keys, usage);
+    }
+}
+
+// Walk the set bits of one word, lowest usage first.
+static void emitWord(uint8_t word, uint32_t bits, uint8_t state) {
+    while(bits) {
+        const uint8_t bit = __builtin_ctz(bits);
+        bits &= bits - 1;
+        handleKey((word << 5) | bit, state);
+    }
+}
+
+// Which of these changed keys are outside their window. The rest are held
+// back, and counted if the report itself just changed them.
+static uint32_t debounceWord(uint8_t word, uint32_t changed, uint32_t rawChanged, uint16_t nowMs) {
+    uint32_t accept = 0;
+
+    while(changed) {
+        const uint8_t bit = __builtin_ctz(changed);
+        changed &= changed - 1;
+        const uint8_t usage = (word << 5) | bit;
+
+        if((uint16_t)(nowMs - lastEdgeMs[usage]) >= debounceMs) {
+            lastEdgeMs[usage] = nowMs;
+            accept |= 1u << bit;
+        }else if(rawChanged & (1u << bit)) {
+            if(keyChatter[usage] != UINT16_MAX) keyChatter[usage]++;
+            statCount(STAT_EVT_KEY_CHATTER);
+            suppressed = true;
+        }
+    }
+    return accept;
+}
+
+// Nothing to do here, the interrupt is enough to get the main loop round to
+// keyStateTask().
+static int64_t windowClosed(alarm_id_t id, void *userData) {
+    return 0;
+}
+
+void keyStateUpdate(const keyBitmap_t *keys) {
+    const uint16_t nowMs = to_ms_since_boot(get_absolute_time());
+    uint32_t accept[KEY_BITMAP_WORDS];
+    bool waiting = false;
+    suppressed = false;
+
+    for(uint8_t i = 0; i < KEY_BITMAP_WORDS; i++) {
+        const uint32_t changed = keyState.w[i] ^ keys->w[i];
+        accept[i] = changed;
+
+        if(changed && debounceMs) {
+            accept[i] = debounceWord(i, changed, rawState.w[i] ^ keys->w[i], nowMs);
+            if(accept[i] != changed) waiting = true;
+        }
+
+        emitWord(i, accept[i] & keyState.w[i], USBKEY_RELEASED);
+    }
+
+    for(uint8_t i = 0; i < KEY_BITMAP_WORDS; i++) {
+        emitWord(i, accept[i] & keys->w[i], USBKEY_PRESSED);
+        keyState.w[i] ^= accept[i];
+    }
+
+    rawState = *keys;
+
+    // Come back when the window's up. Only a fresh edge can need a new
+    // window, catching up on an old one never does.
+    if(suppressed) add_alarm_in_ms(debounceMs, windowClosed, NULL, true);
+    held = waiting;
+}
+
+void keyStateTask(void) {
+    if(held) keyStateUpdate(&rawState);
+}
+
+void keyStateSetDebounce(uint8_t ms) {
+    debounceMs = ms;
+}
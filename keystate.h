@@ -0,0 +1,59 @@
+// Pressed-key state as a 256 bit bitmap indexed by USB usage.
+
+#ifndef _KEYSTATE_H_INCLUDED
+#define _KEYSTATE_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "tusb.h"
+
+#define KEY_BITMAP_WORDS 8
+
+// Edges closer together than this after a key's last one are switch chatter.
+#define KEY_DEBOUNCE_MS_DEFAULT 5
+
+// Modifiers live at their usages 0xE0-0xE7, i.e. the low byte of the last word.
+typedef struct {
+    uint32_t w[KEY_BITMAP_WORDS];
+} keyBitmap_t;
+
+static inline void keyBitmapClear(keyBitmap_t *keys) {
+    for(uint8_t i = 0; i < KEY_BITMAP_WORDS; i++) keys->w[i] = 0;
+}
+
+static inline void keyBitmapSet(keyBitmap_t *keys, uint8_t usage) {
+    keys->w[usage >> 5] |= 1u << (usage & 31);
+}
+
+static inline void keyBitmapUnset(keyBitmap_t *keys, uint8_t usage) {
+    keys->w[usage >> 5] &= ~(1u << (usage & 31));
+}
+
+static inline void keyBitmapOr(keyBitmap_t *keys, const keyBitmap_t *other) {
+    for(uint8_t i = 0; i < KEY_BITMAP_WORDS; i++) keys->w[i] |= other->w[i];
+}
+
+static inline bool keyBitmapTest(const keyBitmap_t *keys, uint8_t usage) {
+    return (keys->w[usage >> 5] >> (usage & 31)) & 1;
+}
+
+// Fill from a 6KRO boot report. False if the keyboard reported ErrorRollOver,
+// in which case the report says nothing about which keys are down.
+bool keyBitmapFromBoot(keyBitmap_t *keys, hid_keyboard_report_t const *report);
+
+// OR in up to 32 bits of an NKRO style bitfield, one bit per usage from firstUsage.
+void keyBitmapAddBits(keyBitmap_t *keys, uint16_t firstUsage, uint32_t bits, uint8_t bitCount);
+
+// Make keys the current state, emitting handleKey() for each transition.
+// Releases go first, then presses, modifiers last in each pass. Keys still
+// inside their debounce window catch up from keyStateTask().
+void keyStateUpdate(const keyBitmap_t *keys);
+void keyStateTask(void);
+
+// 0 turns debounce off.
+void keyStateSetDebounce(uint8_t ms);
+
+// Edges held back per usage, saturating. Chattering switches stand out here.
+extern uint16_t keyChatter[256];
+
+#endif
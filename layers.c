@@ -0,0 +1,214 @@
+// Layers, dual-role keys and combos.
+//
+// Every event is a handful of table lookups: the layer tables and the action
+// and combo indexes all come ready made from layout.c, and the number of
+// layers is fixed.
+//
+// Keys that can't be decided on the spot (a dual-role key, or the first half
+// of a combo) are held as the one pending key. A hardware alarm settles it if
+// nothing else does first, so the decision never waits on the main loop.
+// Any other key going down settles it too: a dual-role key becomes its hold
+// half, a combo key just itself. Keys with neither go straight through.
+//
+// Alarms run in interrupt context, so the main loop side runs with
+// interrupts off.
+
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include "layers.h"
+#include "layout.h"
+#include "PicoX68Key.h"
+
+#define TAP_HOLD_US 200000  // Held past this, a dual-role key is its hold half
+#define COMBO_US     30000  // Both keys of a combo must go down within this
+
+typedef enum {
+    PENDING_NONE = 0,
+    PENDING_TAP_HOLD,
+    PENDING_COMBO
+} pendingKind_t;
+
+static uint8_t layerHolds[LAYOUT_LAYERS];
+static uint8_t layerToggles = 0;
+static volatile uint8_t layerMask = 1 << LAYOUT_LAYER_NORMAL;
+
+// What each held key turned into, so releasing it undoes exactly that even if
+// the layers (or the layout) changed in between.
+static uint8_t pressedCode[256];
+static uint8_t pressedLayer[256];   // Layer + 1
+
+static struct {
+    uint8_t kind;
+    uint8_t usage;
+    alarm_id_t alarm;
+} pending;
+
+static void updateMask(void) {
+    uint8_t mask = (1 << LAYOUT_LAYER_NORMAL) | layerToggles;
+    for(uint8_t l = 0; l < LAYOUT_LAYERS; l++) {
+        if(layerHolds[l]) mask |= 1 << l;
+    }
+    layerMask = mask;
+}
+
+static void holdLayer(uint8_t usage, uint8_t layer) {
+    if(layer >= LAYOUT_LAYERS) return;
+    layerHolds[layer]++;
+    pressedLayer[usage] = layer + 1;
+    updateMask();
+}
+
+// Highest active layer that has something for this key.
+static uint8_t lookup(uint8_t usage) {
+    for(int8_t l = LAYOUT_LAYERS - 1; l >= 0; l--) {
+        if(!(layerMask & (1 << l))) continue;
+        const uint8_t code = layoutLookup(l, usage);
+        if(code) return code;
+    }
+    return 0;
+}
+
+static void pressCode(uint8_t usage, uint8_t code) {
+    if(!code) return;
+    pressedCode[usage] = code;
+    keyDown(code);
+}
+
+static void pressNow(uint8_t usage) {
+    const layoutAction_t *a = layoutAction(usage);
+
+    if(a && a->kind == LAYOUT_ACTION_LAYER_HOLD) {
+        holdLayer(usage, a->hold);
+        return;
+    }
+
+    if(a && a->kind == LAYOUT_ACTION_LAYER_TOGGLE) {
+        if(a->hold < LAYOUT_LAYERS) layerToggles ^= 1 << a->hold;
+        updateMask();
+        return;
+    }
+
+    pressCode(usage, lookup(usage));
+}
+
+static void releaseNow(uint8_t usage) {
+    if(pressedLayer[usage]) {
+        layerHolds[pressedLayer[usage] - 1]--;
+        pressedLayer[usage] = 0;
+        updateMask();
+    }
+
+    const uint8_t code = pressedCode[usage];
+    if(!code) return;
+    pressedCode[usage] = 0;
+
+    // Both keys of a combo hold the same code. The first one up releases it.
+    const layoutCombo_t *c = layoutCombo(usage);
+    if(c && c->x68 == code) {
+        const uint8_t other = usage == c->usb1 ? c->usb2 : c->usb1;
+        if(pressedCode[other] == code) pressedCode[other] = 0;
+    }
+
+    keyUp(code);
+}
+
+static void cancelPendingAlarm(void) {
+    if(pending.alarm > 0) cancel_alarm(pending.alarm);
+    pending.alarm = 0;
+}
+
+// Something happened before the pending key could decide for itself.
+static void settlePending(void) {
+    const uint8_t kind = pending.kind;
+    if(kind == PENDING_NONE) return;
+
+    cancelPendingAlarm();
+    pending.kind = PENDING_NONE;
+
+    if(kind == PENDING_TAP_HOLD) {
+        const layoutAction_t *a = layoutAction(pending.usage);
+        if(!a) return;
+        if(a->kind == LAYOUT_ACTION_TAP_LAYER) holdLayer(pending.usage, a->hold);
+        else pressCode(pending.usage, a->hold);
+    }else{
+        pressNow(pending.usage);
+    }
+}
+
+static int64_t pendingTimeout(alarm_id_t id, void *userData) {
+    if(id == pending.alarm) {
+        pending.alarm = 0;
+        settlePending();
+    }
+    return 0;
+}
+
+static void startPending(uint8_t kind, uint8_t usage, uint32_t us) {
+    pending.kind = kind;
+    pending.usage = usage;
+    pending.alarm = add_alarm_in_us(us, pendingTimeout, NULL, true);
+}
+
+static void keyPressed(uint8_t usage) {
+    // The other half of the pending combo.
+    if(pending.kind == PENDING_COMBO && usage != pending.usage) {
+        const layoutCombo_t *c = layoutCombo(usage);
+        if(c && c == layoutCombo(pending.usage)) {
+            cancelPendingAlarm();
+            pending.kind = PENDING_NONE;
+            pressedCode[pending.usage] = c->x68;
+            pressCode(usage, c->x68);
+            return;
+        }
+    }
+
+    settlePending();
+
+    const layoutAction_t *a = layoutAction(usage);
+    if(a && (a->kind == LAYOUT_ACTION_TAP_KEY || a->kind == LAYOUT_ACTION_TAP_LAYER)) {
+        startPending(PENDING_TAP_HOLD, usage, TAP_HOLD_US);
+    }else if(layoutCombo(usage)) {
+        startPending(PENDING_COMBO, usage, COMBO_US);
+    }else{
+        pressNow(usage);
+    }
+}
+
+static void keyReleased(uint8_t usage) {
+    if(pending.kind != PENDING_NONE && pending.usage == usage) {
+        const uint8_t kind = pending.kind;
+        cancelPendingAlarm();
+        pending.kind = PENDING_NONE;
+
+        if(kind == PENDING_TAP_HOLD) {
+            const layoutAction_t *a = layoutAction(usage);
+            if(a && a->tap) {
+                keyDown(a->tap);
+                keyUp(a->tap);
+            }
+        }else{
+            // Half a combo on its own is just a key.
+            pressNow(usage);
+            releaseNow(usage);
+        }
+        return;
+    }
+
+    // Keep the order the keys really went in.
+    if(pending.kind == PENDING_COMBO) settlePending();
+
+    releaseNow(usage);
+}
+
+void layersKey(uint8_t usage, uint8_t state) {
+    const uint32_t irqState = save_and_disable_interrupts();
+
+    if(state == USBKEY_PRESSED) keyPressed(usage);
+    else if(state == USBKEY_RELEASED) keyReleased(usage);
+
+    restore_interrupts(irqState);
+}
+
+bool layersActive(uint8_t layer) {
+    return layerMask & (1 << layer);
+}
@@ -0,0 +1,15 @@
+// Layers, dual-role keys and combos.
+
+#ifndef _LAYERS_H_INCLUDED
+#define _LAYERS_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// A USB key event that isn't one of the adaptor's own chords. Sends whatever
+// it turns into through keyDown()/keyUp().
+void layersKey(uint8_t usage, uint8_t state);
+
+bool layersActive(uint8_t layer);
+
+#endif
@@ -0,0 +1,81 @@
+// Keyboard layouts: USB usage to X68000 scan code.
+//
+// Layouts are const and stay in flash. Selecting one expands it into a table
+// per layer in SRAM, plus indexes for the keys with actions or combos, so the
+// layer engine never has to search a list.
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "layout.h"
+
+// Compiled from layouts/*.layout at build time.
+#include "layouts.h"
+
+static const layout_t *const layouts[] = {LAYOUT_LIST};
+
+uint8_t layoutActive[LAYOUT_LAYERS][256];
+uint8_t layoutActionIndex[256];
+uint8_t layoutComboIndex[256];
+const layoutAction_t *layoutActions = NULL;
+const layoutCombo_t *layoutCombos = NULL;
+static uint8_t activeIndex = 0;
+
+static const layoutKey_t *userRemaps = NULL;
+static uint8_t userRemapCount = 0;
+
+uint8_t layoutCount(void) {
+    return count_of(layouts);
+}
+
+uint8_t layoutCurrent(void) {
+    return activeIndex;
+}
+
+const char *layoutName(uint8_t index) {
+    return index < count_of(layouts) ? layouts[index]->name : NULL;
+}
+
+void layoutSelect(uint8_t index) {
+    if(index >= count_of(layouts)) index = 0;
+
+    const layout_t *layout = layouts[index];
+    uint8_t *normal = layoutActive[LAYOUT_LAYER_NORMAL];
+    uint8_t *special = layoutActive[LAYOUT_LAYER_SPECIAL];
+    uint8_t *fn = layoutActive[LAYOUT_LAYER_FN];
+
+    memcpy(normal, layout->keymap, 256);
+    for(uint8_t i = 0; i < userRemapCount; i++) {
+        normal[userRemaps[i].usb] = userRemaps[i].x68;
+    }
+
+    memset(special, 0, 256);
+    for(uint8_t i = 0; i < layout->specialCount; i++) {
+        special[layout->specialKeys[i].usb] = layout->specialKeys[i].x68;
+    }
+
+    memset(fn, 0, 256);
+    for(uint8_t i = 0; i < layout->fnCount; i++) {
+        fn[layout->fnKeys[i].usb] = layout->fnKeys[i].x68;
+    }
+
+    memset(layoutActionIndex, 0, sizeof(layoutActionIndex));
+    for(uint8_t i = 0; i < layout->actionCount; i++) {
+        layoutActionIndex[layout->actions[i].usb] = i + 1;
+    }
+    layoutActions = layout->actions;
+
+    memset(layoutComboIndex, 0, sizeof(layoutComboIndex));
+    for(uint8_t i = 0; i < layout->comboCount; i++) {
+        layoutComboIndex[layout->combos[i].usb1] = i + 1;
+        layoutComboIndex[layout->combos[i].usb2] = i + 1;
+    }
+    layoutCombos = layout->combos;
+
+    activeIndex = index;
+}
+
+void layoutSetRemaps(const layoutKey_t *remaps, uint8_t count) {
+    userRemaps = remaps;
+    userRemapCount = remaps ? count : 0;
+    layoutSelect(activeIndex);
+}
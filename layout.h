@@ -0,0 +1,99 @@
+// Keyboard layouts: USB usage to X68000 scan code.
+
+#ifndef _LAYOUT_H_INCLUDED
+#define _LAYOUT_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define CTRL_SCAN 0x71
+#define SHIFT_SCAN 0x70
+#define HIRA_SCAN 0x56
+#define WIDTH_SCAN 0x60
+#define OPT1_SCAN 0x72
+#define OPT2_SCAN 0x73
+
+// Layers above normal only list the keys they change. Anything else falls
+// through to the next active layer down.
+#define LAYOUT_LAYER_NORMAL  0
+#define LAYOUT_LAYER_SPECIAL 1  // While Left GUI is held
+#define LAYOUT_LAYER_FN      2  // Extra X68000 keys for keyboards without them
+#define LAYOUT_LAYERS        3
+
+typedef struct {
+    uint8_t usb;
+    uint8_t x68;
+} layoutKey_t;
+
+// Keys that do something other than send one scan code.
+typedef enum {
+    LAYOUT_ACTION_NONE = 0,
+    LAYOUT_ACTION_LAYER_HOLD,       // layer while held
+    LAYOUT_ACTION_LAYER_TOGGLE,     // layer on/off each press
+    LAYOUT_ACTION_TAP_KEY,          // tap sends tap, held sends hold as a scan code
+    LAYOUT_ACTION_TAP_LAYER,        // tap sends tap, held turns on layer hold
+} layoutActionKind_t;
+
+typedef struct {
+    uint8_t usb;
+    uint8_t kind;
+    uint8_t tap;                    // Scan code
+    uint8_t hold;                   // Scan code or layer, depending on kind
+} layoutAction_t;
+
+// Two keys pressed together send x68 instead. A key can be in one combo.
+typedef struct {
+    uint8_t usb1;
+    uint8_t usb2;
+    uint8_t x68;
+} layoutCombo_t;
+
+// A full keymap plus the sparse upper layers. tools/layoutc.cmake writes these
+// from layouts/*.layout.
+typedef struct {
+    const char *name;
+    const uint8_t *keymap;              // 256 entries
+    const layoutKey_t *specialKeys;     // Special layer
+    uint8_t specialCount;
+    const layoutKey_t *fnKeys;          // Fn layer
+    uint8_t fnCount;
+    const layoutAction_t *actions;
+    uint8_t actionCount;
+    const layoutCombo_t *combos;
+    uint8_t comboCount;
+} layout_t;
+
+// The active layout, expanded into all layers. Lives in SRAM so lookups
+// never wait on an XIP cache miss. Zero means "not on this layer".
+extern uint8_t layoutActive[LAYOUT_LAYERS][256];
+
+// Per usage, one more than the index of its action or combo, or zero.
+extern uint8_t layoutActionIndex[256];
+extern uint8_t layoutComboIndex[256];
+extern const layoutAction_t *layoutActions;
+extern const layoutCombo_t *layoutCombos;
+
+uint8_t layoutCount(void);
+uint8_t layoutCurrent(void);
+const char *layoutName(uint8_t index);
+void layoutSelect(uint8_t index);
+
+// User remaps, applied to the normal layer of whichever layout is selected.
+// They show through any upper layer that leaves the key transparent. The
+// table is used where it is, so it must outlive the next layoutSelect().
+void layoutSetRemaps(const layoutKey_t *remaps, uint8_t count);
+
+static inline uint8_t layoutLookup(uint8_t layer, uint8_t usage) {
+    return layoutActive[layer][usage];
+}
+
+static inline const layoutAction_t *layoutAction(uint8_t usage) {
+    return layoutActionIndex[usage] ? &layoutActions[layoutActionIndex[usage] - 1] : NULL;
+}
+
+static inline const layoutCombo_t *layoutCombo(uint8_t usage) {
+    return layoutComboIndex[usage] ? &layoutCombos[layoutComboIndex[usage] - 1] : NULL;
+}
+
+#endif
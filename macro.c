@@ -0,0 +1,180 @@
+// Timer driven macro / typing engine.
+//
+// press() used to sleep 20ms per key, freezing USB for the whole time. Now
+// scripted keys go into a step queue that an alarm callback plays out. Steps
+// with no delay go as fast as the link will take them, but only while the TX
+// ring has room, so live typing always gets a look in.
+//
+// Recordings keep the time between keys, up to 255ms per gap, so a recorded
+// macro plays back at the pace it was typed.
+//
+// X68000 modifiers the user is physically holding are released for the
+// length of a macro and put back afterwards, otherwise a held SHIFT would
+// change everything the macro types.
+
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include "macro.h"
+#include "x68k_port.h"
+
+// Must be a power of two.
+#define MACRO_QUEUE_SIZE 256
+
+// Playback only uses the TX ring up to here.
+#define MACRO_TX_LIMIT 16
+
+// One byte on the wire at 2400 baud, 8N1.
+#define MACRO_BYTE_US 4167
+
+#define X68_MOD_FIRST 0x70  // SHIFT, CTRL, OPT.1, OPT.2
+#define X68_MOD_COUNT 4
+
+static macroStep_t queue[MACRO_QUEUE_SIZE];
+static volatile uint16_t queueHead = 0, queueTail = 0;
+static volatile bool playing = false;
+
+static uint8_t liveMods = 0;
+static uint8_t suspendedMods = 0;
+
+macroStep_t macroSlots[MACRO_SLOTS][MACRO_SLOT_STEPS];
+uint8_t macroSlotLength[MACRO_SLOTS];
+
+static bool recording = false;
+static macroStep_t recordBuf[MACRO_SLOT_STEPS];
+static uint8_t recordLen = 0;
+static uint32_t recordLastMs;
+
+static void sendMods(uint8_t mods, uint8_t releaseBit) {
+    for(uint8_t i = 0; i < X68_MOD_COUNT; i++) {
+        if(mods & (1 << i)) kbSend((X68_MOD_FIRST + i) | releaseBit);
+    }
+}
+
+static int64_t playStep(alarm_id_t id, void *userData) {
+    if(!suspendedMods && liveMods) {
+        suspendedMods = liveMods;
+        sendMods(suspendedMods, 0x80);
+    }
+
+    while(queueTail != queueHead) {
+        if(ringCount(&kbTxQueue) >= MACRO_TX_LIMIT) return -MACRO_BYTE_US;
+
+        const macroStep_t step = queue[queueTail & (MACRO_QUEUE_SIZE - 1)];
+        queueTail = queueTail + 1;
+        kbSend(step.code);
+
+        if(step.delayMs) return -(int64_t)step.delayMs * 1000;
+    }
+
+    // Done. Put back whatever the user is still holding.
+    sendMods(suspendedMods & liveMods, 0);
+    suspendedMods = 0;
+    playing = false;
+    return 0;
+}
+
+// Start the player if it's idle. Main loop only.
+static void kick(void) {
+    const uint32_t irqState = save_and_disable_interrupts();
+    const bool start = !playing;
+    playing = true;
+    restore_interrupts(irqState);
+
+    // No alarm to be had: stay idle so the next kick tries again, rather than
+    // playing forever with nothing to play.
+    if(start && add_alarm_in_us(0, playStep, NULL, true) <= 0) playing = false;
+}
+
+uint16_t macroSpace(void) {
+    return MACRO_QUEUE_SIZE - (uint16_t)(queueHead - queueTail);
+}
+
+uint16_t macroQueued(void) {
+    return MACRO_QUEUE_SIZE - macroSpace();
+}
+
+bool macroQueue(uint8_t code, uint8_t delayMs) {
+    if(!macroSpace()) return false;
+
+    queue[queueHead & (MACRO_QUEUE_SIZE - 1)] = (macroStep_t){ code, delayMs };
+    __dmb();
+    queueHead = queueHead + 1;
+
+    kick();
+    return true;
+}
+
+bool macroTap(uint8_t code) {
+    if(macroSpace() < 2) return false;
+    macroQueue(code, 0);
+    macroQueue(code | 0x80, 0);
+    return true;
+}
+
+void macroNoteLive(uint8_t code) {
+    const uint8_t key = code & 0x7F;
+
+    if(key >= X68_MOD_FIRST && key < X68_MOD_FIRST + X68_MOD_COUNT) {
+        const uint8_t bit = 1 << (key - X68_MOD_FIRST);
+        const uint32_t irqState = save_and_disable_interrupts();
+        if(code & 0x80) liveMods &= ~bit; else liveMods |= bit;
+        restore_interrupts(irqState);
+    }
+
+    if(recording && recordLen < MACRO_SLOT_STEPS) {
+        // The time since the previous key is that step's wait, as far as it fits.
+        const uint32_t nowMs = to_ms_since_boot(get_absolute_time());
+        if(recordLen) {
+            const uint32_t gapMs = nowMs - recordLastMs;
+            recordBuf[recordLen - 1].delayMs = gapMs > UINT8_MAX ? UINT8_MAX : gapMs;
+        }
+        recordLastMs = nowMs;
+        recordBuf[recordLen++] = (macroStep_t){ code, 0 };
+    }
+}
+
+void macroRecordStart(void) {
+    recordLen = 0;
+    recording = true;
+}
+
+// Keys still held when recording stops get their releases added, so playback
+// never leaves anything stuck down.
+void macroRecordStop(uint8_t slot) {
+    if(!recording || slot >= MACRO_SLOTS) return;
+    recording = false;
+
+    uint8_t len = 0;
+    for(uint8_t i = 0; i < recordLen; i++) macroSlots[slot][len++] = recordBuf[i];
+
+    for(uint8_t i = 0; i < recordLen && len < MACRO_SLOT_STEPS; i++) {
+        const uint8_t code = recordBuf[i].code;
+        if(code & 0x80) continue;
+
+        bool released = false;
+        for(uint8_t j = i + 1; j < recordLen; j++) {
+            if(recordBuf[j].code == (code | 0x80)) released = true;
+            if(recordBuf[j].code == code) break;
+        }
+        if(!released) macroSlots[slot][len++] = (macroStep_t){ code | 0x80, 0 };
+    }
+
+    macroSlotLength[slot] = len;
+}
+
+void macroRecordCancel(void) {
+    recording = false;
+}
+
+bool macroRecording(void) {
+    return recording;
+}
+
+void macroPlay(uint8_t slot) {
+    if(slot >= MACRO_SLOTS || recording) return;
+    if(macroSpace() < macroSlotLength[slot]) return;
+
+    for(uint8_t i = 0; i < macroSlotLength[slot]; i++) {
+        macroQueue(macroSlots[slot][i].code, macroSlots[slot][i].delayMs);
+    }
+}
@@ -0,0 +1,42 @@
+// Timer driven macro / typing engine.
+
+#ifndef _MACRO_H_INCLUDED
+#define _MACRO_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MACRO_SLOTS 10
+#define MACRO_SLOT_STEPS 64
+
+// One X68000 scan code (bit 7 set for release) and how long to wait after it.
+typedef struct {
+    uint8_t code;
+    uint8_t delayMs;
+} macroStep_t;
+
+// Queue steps for playback. False if the queue is full.
+bool macroQueue(uint8_t code, uint8_t delayMs);
+
+// Press and release a key at full link rate.
+bool macroTap(uint8_t code);
+
+uint16_t macroSpace(void);
+uint16_t macroQueued(void);
+
+// Live X68000 key traffic, so playback can step around held modifiers and
+// recordings can capture it.
+void macroNoteLive(uint8_t code);
+
+void macroRecordStart(void);
+void macroRecordStop(uint8_t slot);
+void macroRecordCancel(void);
+bool macroRecording(void);
+
+void macroPlay(uint8_t slot);
+
+// Recorded macros, so they can be saved and restored elsewhere.
+extern macroStep_t macroSlots[MACRO_SLOTS][MACRO_SLOT_STEPS];
+extern uint8_t macroSlotLength[MACRO_SLOTS];
+
+#endif
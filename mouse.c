@@ -0,0 +1,64 @@
+// Mouse motion scaling.
+//
+// USB mice report far more counts per inch than the X68000 expects, so motion
+// is divided down. Doing that with integer division per report throws away
+// the remainder every time, and slow movement from 1000Hz mice vanishes.
+// Instead each report is scaled in 20.12 fixed point through a lookup table
+// (which also gives us acceleration for free) and the fraction is kept.
+
+#include "pico/stdlib.h"
+#include "mouse.h"
+
+#define MOUSE_DIVIDER 0x03
+
+#define MOUSE_FRAC_BITS 12
+#define MOUSE_CURVE_SIZE 128
+
+// Output in fixed point for each input speed 0-127. Rebuilt when the curve changes.
+static int32_t curveTable[MOUSE_CURVE_SIZE];
+
+// Gain ramps from 1x up to (1 + k)x by the time speed reaches 32 counts/report.
+static const uint8_t curveAccel[MOUSE_CURVE_COUNT] = { 0, 1, 3 };
+
+static mouseCurve_t activeCurve = MOUSE_CURVE_LINEAR;
+
+void mouseSetCurve(mouseCurve_t curve) {
+    if(curve >= MOUSE_CURVE_COUNT) curve = MOUSE_CURVE_LINEAR;
+
+    const int32_t k = curveAccel[curve];
+    for(int32_t v = 0; v < MOUSE_CURVE_SIZE; v++) {
+        const int32_t ramp = v < 32 ? v : 32;
+        curveTable[v] = ((v << MOUSE_FRAC_BITS) * (32 + k * ramp)) / (32 * MOUSE_DIVIDER);
+    }
+    activeCurve = curve;
+}
+
+mouseCurve_t mouseGetCurve(void) {
+    return activeCurve;
+}
+
+static int32_t scaleAxis(int16_t v) {
+    const int32_t mag = v < 0 ? -v : v;
+    int32_t out;
+
+    // Past the table (16 bit deltas) just carry on at the top gain.
+    if(mag < MOUSE_CURVE_SIZE) {
+        out = curveTable[mag];
+    }else{
+        out = curveTable[MOUSE_CURVE_SIZE - 1] / (MOUSE_CURVE_SIZE - 1) * mag;
+    }
+
+    return v < 0 ? -out : out;
+}
+
+void mouseScale(mouseMotion_t *m, int16_t x, int16_t y, int32_t *outX, int32_t *outY) {
+    m->fracX += scaleAxis(x);
+    m->fracY += scaleAxis(y);
+
+    // Truncate toward zero so both directions need a full count to move.
+    *outX = m->fracX / (1 << MOUSE_FRAC_BITS);
+    *outY = m->fracY / (1 << MOUSE_FRAC_BITS);
+
+    m->fracX -= *outX * (1 << MOUSE_FRAC_BITS);
+    m->fracY -= *outY * (1 << MOUSE_FRAC_BITS);
+}
@@ -0,0 +1,28 @@
+// Mouse motion scaling.
+
+#ifndef _MOUSE_H_INCLUDED
+#define _MOUSE_H_INCLUDED
+
+#include <stdint.h>
+
+typedef enum {
+    MOUSE_CURVE_LINEAR = 0,
+    MOUSE_CURVE_MILD,
+    MOUSE_CURVE_STRONG,
+    MOUSE_CURVE_COUNT
+} mouseCurve_t;
+
+// Sub-count remainder carried between USB reports, per axis.
+typedef struct {
+    int32_t fracX, fracY;
+} mouseMotion_t;
+
+void mouseSetCurve(mouseCurve_t curve);
+mouseCurve_t mouseGetCurve(void);
+
+// Scale raw USB counts to X68000 counts. Whatever doesn't make a whole count
+// stays in the remainder for next time. A full scale 16 bit delta comes out
+// well past 16 bits with acceleration, so the result is 32 bit.
+void mouseScale(mouseMotion_t *m, int16_t x, int16_t y, int32_t *outX, int32_t *outY);
+
+#endif
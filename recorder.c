@@ -0,0 +1,353 @@
+// Flight recorder: the last few seconds of USB input and X68000 traffic.
+//
+// Every HID report and every byte either way on the keyboard and mouse ports
+// is appended to a log in RAM, timestamped relative to the record before it.
+// When a log fills, its oldest records are dropped to make room. Left GUI +
+// F8 freezes both logs and DMAs them out of a spare pin, so "the mouse
+// jumped" comes with what actually happened. The report descriptors of the
+// interfaces involved go with them, so the capture can be replayed.
+//
+// Each core writes only its own log. A log's write count is odd while a
+// record is going in, and it's bumped before the frozen flag is checked, so
+// once frozen is set and the count is even nothing more will be written.
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "recorder.h"
+#include "recorder_tx.pio.h"
+#include "layout.h"
+#include "mouse.h"
+
+// Must be powers of two. Core0 sees far more bytes: every report in full.
+#define RECORDER_LOG0_SIZE 16384
+#define RECORDER_LOG1_SIZE 4096
+
+#define RECORDER_MAX_REPORT 64
+#define RECORDER_HEADER_SIZE (7 + RECORDER_LOGS * 9)
+#define RECORDER_DEVICE_LIST_SIZE (1 + RECORDER_DEVICES * (5 + RECORDER_MAX_DESC))
+
+typedef struct {
+    uint8_t *buf;
+    uint32_t mask;
+    uint32_t head;              // Free running
+    uint32_t tail;
+    uint32_t lastUs;            // Newest record
+    uint32_t baseUs;            // The record before tail
+    volatile uint32_t writes;   // Odd while a record is going in
+} recLog_t;
+
+static uint8_t log0Storage[RECORDER_LOG0_SIZE];
+static uint8_t log1Storage[RECORDER_LOG1_SIZE];
+
+static recLog_t logs[RECORDER_LOGS] = {
+    { log0Storage, RECORDER_LOG0_SIZE - 1 },
+    { log1Storage, RECORDER_LOG1_SIZE - 1 },
+};
+
+static volatile bool frozen = false;
+
+typedef struct {
+    bool used;
+    bool mounted;
+    uint8_t devAddr;
+    uint8_t instance;
+    uint8_t itfProtocol;
+    uint16_t len;
+    uint8_t desc[RECORDER_MAX_DESC];
+} recDevice_t;
+
+static recDevice_t devices[RECORDER_DEVICES];
+
+// Capture output. Segments are sent one DMA transfer at a time.
+typedef enum {
+    SEND_IDLE = 0,
+    SEND_HEADER,
+    SEND_DEVICES,
+    SEND_LOG,               // One or two segments per log, where it wraps
+    SEND_TRAILER,
+    SEND_DONE
+} sendState_t;
+
+static PIO txPio;
+static uint txSm;
+static int txDma = -1;
+
+static sendState_t sendState = SEND_IDLE;
+static uint8_t sendLog = 0;
+static uint32_t sendPos = 0;
+static uint8_t header[RECORDER_HEADER_SIZE];
+static uint8_t deviceList[RECORDER_DEVICE_LIST_SIZE];
+static uint16_t deviceListLen = 0;
+static uint8_t trailer[4];
+
+static inline uint8_t logAt(const recLog_t *log, uint32_t pos) {
+    return log->buf[pos & log->mask];
+}
+
+static inline void logPut(recLog_t *log, uint8_t b) {
+    log->buf[log->head++ & log->mask] = b;
+}
+
+static uint8_t payloadLength(const recLog_t *log, uint8_t type, uint32_t pos) {
+    switch(type) {
+        case RECORDER_HID:      return 3 + logAt(log, pos + 2);
+        case RECORDER_MOUSE_TX: return 3;
+        case RECORDER_MOUNT:
+        case RECORDER_UNMOUNT:  return 2;
+        default:                return 1;
+    }
+}
+
+// Drop the oldest record, carrying its time into baseUs.
+static void evict(recLog_t *log) {
+    uint32_t pos = log->tail;
+    const uint8_t type = logAt(log, pos++);
+
+    uint32_t delta = 0;
+    uint8_t shift = 0, b;
+    do {
+        b = logAt(log, pos++);
+        delta |= (uint32_t)(b & 0x7F) << shift;
+        shift += 7;
+    } while(b & 0x80);
+
+    log->baseUs += delta;
+    log->tail = pos + payloadLength(log, type, pos);
+}
+
+static void record(recLog_t *log, uint8_t type, const uint8_t *head, uint8_t headLen, const uint8_t *data, uint8_t len) {
+    const uint32_t irqState = save_and_disable_interrupts();
+
+    log->writes++;
+    __dmb();
+
+    if(!frozen) {
+        const uint32_t now = time_us_32();
+        uint32_t delta = now - log->lastUs;
+
+        uint8_t deltaLen = 1;
+        while(deltaLen < 5 && (delta >> (7 * deltaLen))) deltaLen++;
+
+        const uint32_t need = 1 + deltaLen + headLen + len;
+        while(log->mask + 1 - (log->head - log->tail) < need) evict(log);
+
+        logPut(log, type);
+        while(delta >= 0x80) {
+            logPut(log, (delta & 0x7F) | 0x80);
+            delta >>= 7;
+        }
+        logPut(log, delta);
+        for(uint8_t i = 0; i < headLen; i++) logPut(log, head[i]);
+        for(uint8_t i = 0; i < len; i++) logPut(log, data[i]);
+
+        log->lastUs = now;
+    }
+
+    __dmb();
+    log->writes++;
+
+    restore_interrupts(irqState);
+}
+
+void recorderHidReport(uint8_t devAddr, uint8_t instance, const uint8_t *report, uint16_t len) {
+    if(len > RECORDER_MAX_REPORT) len = RECORDER_MAX_REPORT;
+    const uint8_t head[3] = { devAddr, instance, len };
+    record(&logs[RECORDER_LOG_CORE0], RECORDER_HID, head, sizeof(head), report, len);
+}
+
+void recorderKeyTx(uint8_t code) {
+    record(&logs[RECORDER_LOG_CORE0], RECORDER_KEY_TX, NULL, 0, &code, 1);
+}
+
+// Slots are kept in mount order, oldest first. The same interface mounting
+// again gets its old slot, else a free one, else the oldest that's gone. An
+// interface still plugged in keeps its slot.
+static recDevice_t *deviceSlot(uint8_t devAddr, uint8_t instance) {
+    recDevice_t *free = NULL;
+
+    for(uint8_t i = 0; i < RECORDER_DEVICES; i++) {
+        recDevice_t *d = &devices[i];
+        if(d->used && d->devAddr == devAddr && d->instance == instance) return d;
+        if(!free && !d->used) free = d;
+    }
+    if(free) return free;
+
+    for(uint8_t i = 0; i < RECORDER_DEVICES; i++) {
+        if(!devices[i].mounted) return &devices[i];
+    }
+    return NULL;
+}
+
+void recorderMount(uint8_t devAddr, uint8_t instance, uint8_t itfProtocol, const uint8_t *desc, uint16_t len) {
+    const uint8_t head[2] = { devAddr, instance };
+    record(&logs[RECORDER_LOG_CORE0], RECORDER_MOUNT, head, sizeof(head), NULL, 0);
+
+    recDevice_t *d = deviceSlot(devAddr, instance);
+    if(!d) return;
+
+    memmove(d, d + 1, (&devices[RECORDER_DEVICES] - (d + 1)) * sizeof(recDevice_t));
+    d = &devices[RECORDER_DEVICES - 1];
+
+    if(len > RECORDER_MAX_DESC) len = RECORDER_MAX_DESC;
+    d->used = true;
+    d->mounted = true;
+    d->devAddr = devAddr;
+    d->instance = instance;
+    d->itfProtocol = itfProtocol;
+    d->len = len;
+    if(len) memcpy(d->desc, desc, len);
+}
+
+void recorderUnmount(uint8_t devAddr, uint8_t instance) {
+    const uint8_t head[2] = { devAddr, instance };
+    record(&logs[RECORDER_LOG_CORE0], RECORDER_UNMOUNT, head, sizeof(head), NULL, 0);
+
+    for(uint8_t i = 0; i < RECORDER_DEVICES; i++) {
+        recDevice_t *d = &devices[i];
+        if(d->used && d->devAddr == devAddr && d->instance == instance) d->mounted = false;
+    }
+}
+
+void recorderKeyRx(uint8_t cmd) {
+    record(&logs[RECORDER_LOG_CORE1], RECORDER_KEY_RX, NULL, 0, &cmd, 1);
+}
+
+void recorderMouseTx(const uint8_t *packet) {
+    record(&logs[RECORDER_LOG_CORE1], RECORDER_MOUSE_TX, NULL, 0, packet, 3);
+}
+
+//--------------------------------------------------------------------+
+// Capture output
+//--------------------------------------------------------------------+
+
+void recorderInit(void) {
+    uint offset;
+    if(!pio_claim_free_sm_and_add_program(&recorder_tx_program, &txPio, &txSm, &offset)) return;
+    recorder_tx_program_init(txPio, txSm, offset, RECORDER_TX_PIN, RECORDER_BAUD);
+
+    txDma = dma_claim_unused_channel(false);
+}
+
+static void putLe32(uint8_t *p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static void send(const uint8_t *bytes, uint32_t count) {
+    dma_channel_config c = dma_channel_get_default_config(txDma);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, pio_get_dreq(txPio, txSm, true));
+
+    dma_channel_configure(txDma, &c, &txPio->txf[txSm], bytes, count, true);
+}
+
+void recorderFreeze(void) {
+    if(txDma < 0 || sendState != SEND_IDLE) return;
+
+    frozen = true;
+    __dmb();
+
+    // A record already going in on the other core takes a microsecond or so.
+    for(uint8_t i = 0; i < RECORDER_LOGS; i++) {
+        while(logs[i].writes & 1) tight_loop_contents();
+    }
+
+    memcpy(header, "X68R", 4);
+    header[4] = RECORDER_VERSION;
+    header[5] = layoutCurrent();
+    header[6] = mouseGetCurve();
+
+    // Copied, since a device can mount while the capture is going out.
+    uint8_t *p = deviceList;
+    *p++ = 0;
+    for(uint8_t i = 0; i < RECORDER_DEVICES; i++) {
+        const recDevice_t *d = &devices[i];
+        if(!d->used) continue;
+
+        deviceList[0]++;
+        *p++ = d->devAddr;
+        *p++ = d->instance;
+        *p++ = d->itfProtocol;
+        *p++ = d->len;
+        *p++ = d->len >> 8;
+        memcpy(p, d->desc, d->len);
+        p += d->len;
+    }
+    deviceListLen = p - deviceList;
+
+    uint32_t sum = 0;
+    for(uint16_t i = 0; i < deviceListLen; i++) sum += deviceList[i];
+
+    for(uint8_t i = 0; i < RECORDER_LOGS; i++) {
+        const recLog_t *log = &logs[i];
+        uint8_t *h = &header[7 + i * 9];
+        h[0] = i;
+        putLe32(&h[1], log->baseUs);
+        putLe32(&h[5], log->head - log->tail);
+
+        for(uint32_t pos = log->tail; pos != log->head; pos++) sum += logAt(log, pos);
+    }
+    putLe32(trailer, sum);
+
+    sendState = SEND_HEADER;
+}
+
+void recorderTask(void) {
+    if(sendState == SEND_IDLE || dma_channel_is_busy(txDma)) return;
+
+    switch(sendState) {
+        case SEND_HEADER:
+            send(header, sizeof(header));
+            sendState = SEND_DEVICES;
+        break;
+
+        case SEND_DEVICES:
+            send(deviceList, deviceListLen);
+            sendLog = 0;
+            sendPos = logs[0].tail;
+            sendState = SEND_LOG;
+        break;
+
+        case SEND_LOG: {
+            const recLog_t *log = &logs[sendLog];
+
+            if(sendPos == log->head) {
+                if(++sendLog < RECORDER_LOGS) {
+                    sendPos = logs[sendLog].tail;
+                }else{
+                    sendState = SEND_TRAILER;
+                }
+                break;
+            }
+
+            // Up to the end of the log or the end of the buffer, whichever is first.
+            const uint32_t offset = sendPos & log->mask;
+            uint32_t count = log->head - sendPos;
+            if(count > log->mask + 1 - offset) count = log->mask + 1 - offset;
+
+            send(&log->buf[offset], count);
+            sendPos += count;
+        }
+        break;
+
+        case SEND_TRAILER:
+            send(trailer, sizeof(trailer));
+            sendState = SEND_DONE;
+        break;
+
+        case SEND_DONE:
+            sendState = SEND_IDLE;
+            frozen = false;
+        break;
+
+        default:
+        break;
+    }
+}
@@ -0,0 +1,61 @@
+// Flight recorder: the last few seconds of USB input and X68000 traffic.
+
+#ifndef _RECORDER_H_INCLUDED
+#define _RECORDER_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Capture output, on a PIO UART (8N1).
+#define RECORDER_TX_PIN  0
+#define RECORDER_BAUD    115200
+
+// Each core keeps its own log, so neither ever waits on the other.
+#define RECORDER_LOG_CORE0 0    // HID reports and scan codes queued
+#define RECORDER_LOG_CORE1 1    // Bytes on the wire to and from the X68000
+#define RECORDER_LOGS      2
+
+// A record is a type byte, the time since the previous record in the same
+// log (microseconds, LEB128), then the payload:
+#define RECORDER_HID      1     // dev_addr, instance, length, report
+#define RECORDER_KEY_TX   2     // scan code, as passed to kbSend()
+#define RECORDER_KEY_RX   3     // command byte from the X68000
+#define RECORDER_MOUSE_TX 4     // three byte mouse packet
+#define RECORDER_MOUNT    5     // dev_addr, instance
+#define RECORDER_UNMOUNT  6     // dev_addr, instance
+
+// Report descriptors are too big to keep in the logs, so the last
+// RECORDER_DEVICES interfaces to mount are kept to one side, descriptors cut
+// to RECORDER_MAX_DESC bytes.
+#define RECORDER_DEVICES  8
+#define RECORDER_MAX_DESC 256
+
+// A capture is "X68R", a version byte, the layout and mouse curve in use when
+// it was frozen, then per log: its number, the time of the record before its
+// oldest one (us, LE32), its length (LE32). Next a device count and for each
+// device: dev_addr, instance, interface protocol, descriptor length (LE16),
+// descriptor. Both logs' bytes follow in order, then the LE32 sum of the
+// device list and the logs.
+#define RECORDER_VERSION 2
+
+void recorderInit(void);
+
+// Core0. Interrupt safe.
+void recorderHidReport(uint8_t devAddr, uint8_t instance, const uint8_t *report, uint16_t len);
+void recorderKeyTx(uint8_t code);
+
+// Core0 main loop.
+void recorderMount(uint8_t devAddr, uint8_t instance, uint8_t itfProtocol, const uint8_t *desc, uint16_t len);
+void recorderUnmount(uint8_t devAddr, uint8_t instance);
+
+// Core1.
+void recorderKeyRx(uint8_t cmd);
+void recorderMouseTx(const uint8_t *packet);
+
+// Stop recording and send what's there. Recording picks up again once it's out.
+void recorderFreeze(void);
+
+// Main loop. Keeps the capture moving.
+void recorderTask(void);
+
+#endif
@@ -0,0 +1,184 @@
+// Keyboard and mouse input from a PC, over a USB serial adaptor.
+//
+// For driving an X68000 test rig from a script. Any serial adaptor TinyUSB
+// has a driver for (CDC ACM, FTDI, CP210x, CH34x) plugged in next to the
+// keyboard is opened at 115200 8N1, as set in tusb_config.h.
+//
+// Events come in batches, so one USB packet can carry dozens of key
+// transitions. A batch is only applied once its checksum has been seen, and
+// then in order, through the same key and button unions the USB devices
+// feed, so the layout, layers, macros and everything downstream behave
+// exactly as if the keys had been pressed on a real keyboard.
+
+#include "pico/stdlib.h"
+#include "tusb.h"
+#include "remote.h"
+#include "PicoX68Key.h"
+#include "x68k_port.h"
+#include "stats.h"
+
+#define REMOTE_MAX_PAYLOAD 255
+
+typedef enum {
+    RX_SYNC1 = 0,
+    RX_SYNC2,
+    RX_LENGTH,
+    RX_PAYLOAD,
+    RX_SUM
+} rxState_t;
+
+static uint8_t cdcIdx = 0xFF;
+
+static rxState_t rxState = RX_SYNC1;
+static uint8_t rxLength;
+static uint8_t rxPos;
+static uint8_t rxSum;
+static uint8_t rxPayload[REMOTE_MAX_PAYLOAD];
+
+static uint8_t ledsSent = 0xFF;
+static bool telemetryWanted = false;
+
+void tuh_cdc_mount_cb(uint8_t idx) {
+    if(cdcIdx != 0xFF) return;
+
+    cdcIdx = idx;
+    rxState = RX_SYNC1;
+    ledsSent = 0xFF;
+}
+
+void tuh_cdc_umount_cb(uint8_t idx) {
+    if(idx != cdcIdx) return;
+
+    cdcIdx = 0xFF;
+    hid_app_remote_release();
+}
+
+// Every event in the batch, or none of them if it doesn't parse.
+static bool applyBatch(const uint8_t *p, uint8_t length, bool apply) {
+    uint8_t pos = 0;
+
+    while(pos < length) {
+        const uint8_t type = p[pos];
+        const uint8_t left = length - pos - 1;
+        const uint8_t *arg = &p[pos + 1];
+
+        switch(type) {
+            case REMOTE_EVT_KEY:
+                if(left < 2) return false;
+                if(apply) hid_app_remote_key(arg[0], arg[1]);
+                pos += 3;
+            break;
+
+            case REMOTE_EVT_MOUSE:
+                if(left < 4) return false;
+                if(apply) hid_app_remote_mouse(arg[0], (int8_t)arg[1], (int8_t)arg[2], (int8_t)arg[3]);
+                pos += 5;
+            break;
+
+            case REMOTE_EVT_TELEMETRY:
+                if(apply) telemetryWanted = true;
+                pos += 1;
+            break;
+
+            case REMOTE_EVT_RELEASE:
+                if(apply) hid_app_remote_release();
+                pos += 1;
+            break;
+
+            default:
+                return false;
+        }
+
+        if(apply) statCount(STAT_EVT_REMOTE_EVENTS);
+    }
+    return true;
+}
+
+static void receive(uint8_t b) {
+    switch(rxState) {
+        case RX_SYNC1:
+            if(b == REMOTE_SYNC1) rxState = RX_SYNC2;
+        break;
+
+        case RX_SYNC2:
+            rxState = b == REMOTE_SYNC_IN ? RX_LENGTH : (b == REMOTE_SYNC1 ? RX_SYNC2 : RX_SYNC1);
+        break;
+
+        case RX_LENGTH:
+            rxLength = b;
+            rxPos = 0;
+            rxSum = 0;
+            rxState = b ? RX_PAYLOAD : RX_SUM;
+        break;
+
+        case RX_PAYLOAD:
+            rxPayload[rxPos++] = b;
+            rxSum += b;
+            if(rxPos == rxLength) rxState = RX_SUM;
+        break;
+
+        case RX_SUM:
+            rxState = RX_SYNC1;
+
+            if(b != rxSum || !applyBatch(rxPayload, rxLength, false)) {
+                statCount(STAT_EVT_REMOTE_BAD);
+                return;
+            }
+
+            applyBatch(rxPayload, rxLength, true);
+            statCount(STAT_EVT_REMOTE_FRAMES);
+        break;
+    }
+}
+
+static void putLe32(uint8_t *p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+// Skipped if the adaptor can't take it all right now. The next one will do.
+static bool sendTelemetry(uint8_t leds) {
+    enum { COUNTERS = STAT_EVENTS + 2, PAYLOAD = 2 + COUNTERS * 4 };
+    uint8_t frame[3 + PAYLOAD + 1];
+
+    if(tuh_cdc_write_available(cdcIdx) < sizeof(frame)) return false;
+
+    uint8_t *p = &frame[3];
+    p[0] = leds;
+    p[1] = COUNTERS;
+    for(uint8_t i = 0; i < STAT_EVENTS; i++) putLe32(&p[2 + i * 4], statEvents[i]);
+    putLe32(&p[2 + STAT_EVENTS * 4], kbTxQueue.highWater);
+    putLe32(&p[6 + STAT_EVENTS * 4], kbTxQueue.overflows);
+
+    uint8_t sum = 0;
+    for(uint8_t i = 0; i < PAYLOAD; i++) sum += p[i];
+
+    frame[0] = REMOTE_SYNC1;
+    frame[1] = REMOTE_SYNC_OUT;
+    frame[2] = PAYLOAD;
+    frame[sizeof(frame) - 1] = sum;
+
+    tuh_cdc_write(cdcIdx, frame, sizeof(frame));
+    tuh_cdc_write_flush(cdcIdx);
+    return true;
+}
+
+void remoteTask(void) {
+    if(cdcIdx == 0xFF || !tuh_cdc_mounted(cdcIdx)) return;
+
+    uint8_t buf[64];
+    uint32_t count;
+    while((count = tuh_cdc_read(cdcIdx, buf, sizeof(buf)))) {
+        for(uint32_t i = 0; i < count; i++) receive(buf[i]);
+    }
+
+    const uint8_t leds = x68kPortLeds();
+    if(telemetryWanted || leds != ledsSent) {
+        if(sendTelemetry(leds)) {
+            telemetryWanted = false;
+            ledsSent = leds;
+        }
+    }
+}
@@ -0,0 +1,27 @@
+// Keyboard and mouse input from a PC, over a USB serial adaptor.
+
+#ifndef _REMOTE_H_INCLUDED
+#define _REMOTE_H_INCLUDED
+
+#include <stdint.h>
+
+// Frames both ways are: two sync bytes, a length, that many bytes of
+// payload, then the 8 bit sum of the payload.
+#define REMOTE_SYNC1    'X'
+#define REMOTE_SYNC_IN  'R'     // PC to adaptor: a batch of events
+#define REMOTE_SYNC_OUT 'T'     // Adaptor to PC: telemetry
+
+// Events in a batch. Nothing in a batch happens unless all of it arrived intact.
+#define REMOTE_EVT_KEY       1  // usage, 1 pressed / 0 released
+#define REMOTE_EVT_MOUSE     2  // buttons (MOUSE_X68_ bits), dx, dy, wheel (int8)
+#define REMOTE_EVT_TELEMETRY 3  // send telemetry now
+#define REMOTE_EVT_RELEASE   4  // let go of every key and button
+
+// Telemetry: the LEDs the X68000 asked for (bit 0 num, 1 caps, 2 scroll),
+// the number of counters, then the counters as LE32: statEvents[] in order,
+// then the TX ring's high water mark and overflows. Also sent unprompted
+// whenever the X68000 changes its LEDs.
+
+void remoteTask(void);
+
+#endif
@@ -0,0 +1,62 @@
+// Single-producer, single-consumer byte ring.
+//
+// The producer only ever writes head and the consumer only ever writes tail,
+// so one side can be an interrupt handler (or the other core) without locks.
+// Size must be a power of two. Indices run freely and wrap at 16 bits.
+
+#ifndef _RING_H_INCLUDED
+#define _RING_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hardware/sync.h"
+
+typedef struct {
+    uint8_t *buf;
+    uint16_t mask;
+    volatile uint16_t head;     // Written by producer
+    volatile uint16_t tail;     // Written by consumer
+    uint16_t highWater;         // Deepest the ring has been
+    uint16_t overflows;         // Bytes dropped because the ring was full
+} ring_t;
+
+#define RING_INIT(storage) { (storage), sizeof(storage) - 1, 0, 0, 0, 0 }
+
+static inline uint16_t ringCount(const ring_t *r) {
+    return (uint16_t)(r->head - r->tail);
+}
+
+static inline bool ringEmpty(const ring_t *r) {
+    return r->head == r->tail;
+}
+
+static inline bool ringPush(ring_t *r, uint8_t c) {
+    const uint16_t head = r->head;
+    const uint16_t used = (uint16_t)(head - r->tail);
+
+    if(used > r->mask) {
+        r->overflows++;
+        return false;
+    }
+
+    r->buf[head & r->mask] = c;
+    __dmb();    // Data must land before head moves
+    r->head = head + 1;
+
+    if(used + 1 > r->highWater) r->highWater = used + 1;
+    return true;
+}
+
+static inline uint8_t ringPeek(const ring_t *r) {
+    return r->buf[r->tail & r->mask];
+}
+
+static inline uint8_t ringPop(ring_t *r) {
+    const uint16_t tail = r->tail;
+    const uint8_t c = r->buf[tail & r->mask];
+    __dmb();    // Read slot before handing it back
+    r->tail = tail + 1;
+    return c;
+}
+
+#endif
@@ -0,0 +1,108 @@
+// Latency histograms and event counters.
+//
+// A field diagnostic with no extra wiring: Left GUI + F11 types a summary
+// into whatever is running on the X68000, one line per stage:
+//   <stage> <count> <max us> <p50 us> <p99 us>
+// then a line of counters:
+//   <reports> <keys> <mouse reports> <mouse polls> <key holds> <unknown cmds>
+//   <sleeps> <idle ms> <boot to key ms> <mount to key ms> <typed chars>
+//   <type drops> <type chars/s> <remote frames> <remote bad frames>
+//   <remote events> <key chatter> <report overflows> <report queue high water>
+//   <report hz> <tx high water> <tx overflows>
+// and, if debounce has caught any, <usage> <edges held back> for each key,
+// up to STATS_CHATTER_MAX keys and then "..." if there are more.
+// All numbers are hex. Percentiles are the upper bound of their log2 bucket.
+// The dump is played out by the macro engine, so it never blocks.
+
+#include "pico/stdlib.h"
+#include "stats.h"
+#include "x68k_port.h"
+#include "macro.h"
+#include "keystate.h"
+
+#define SCAN_SPACE  0x35
+#define SCAN_RETURN 0x1D
+#define SCAN_PERIOD 0x32
+
+// Keys listed for chatter. A keyboard full of bad switches needs a new
+// keyboard, not a longer list.
+#define STATS_CHATTER_MAX 16
+
+// Room for the longest dump: every number at its full width.
+#define STATS_HEX_MAX 9     // 8 digits and a space
+#define STATS_DUMP_MAX (STAT_STAGES * (5 * STATS_HEX_MAX + 1) \
+                        + (STAT_EVENTS + 2) * STATS_HEX_MAX + 1 \
+                        + STATS_CHATTER_MAX * (3 + 5) + 3 + 1)
+
+statHist_t statHists[STAT_STAGES];
+uint32_t statEvents[STAT_EVENTS];
+
+static const uint8_t hexDigitToKeycodeLut[] = {0x0B, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x1E, 0x2E, 0x2C, 0x20, 0x13, 0x21};
+
+static uint8_t dumpCodes[STATS_DUMP_MAX];
+static uint16_t dumpLen = 0, dumpPos = 0;
+
+static void dumpCode(uint8_t c) {
+    if(dumpLen < STATS_DUMP_MAX) dumpCodes[dumpLen++] = c;
+}
+
+// Hex without leading zeros, followed by a space.
+static void dumpHex(uint32_t v) {
+    int8_t shift = 28;
+    while(shift > 0 && !((v >> shift) & 0x0F)) shift -= 4;
+
+    for(; shift >= 0; shift -= 4) dumpCode(hexDigitToKeycodeLut[(v >> shift) & 0x0F]);
+    dumpCode(SCAN_SPACE);
+}
+
+static uint32_t percentileUs(const statHist_t *h, uint8_t percent) {
+    const uint32_t target = (uint32_t)(((uint64_t)h->count * percent + 99) / 100);
+    uint32_t seen = 0;
+
+    for(uint8_t b = 0; b < STAT_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if(seen >= target && seen) return b ? (1u << b) - 1 : 0;
+    }
+    return h->maxUs;
+}
+
+void statsDump(void) {
+    // Already typing one out.
+    if(dumpPos < dumpLen) return;
+
+    dumpLen = 0;
+    dumpPos = 0;
+
+    for(uint8_t s = 0; s < STAT_STAGES; s++) {
+        const statHist_t *h = &statHists[s];
+        dumpHex(s);
+        dumpHex(h->count);
+        dumpHex(h->maxUs);
+        dumpHex(percentileUs(h, 50));
+        dumpHex(percentileUs(h, 99));
+        dumpCode(SCAN_RETURN);
+    }
+
+    for(uint8_t e = 0; e < STAT_EVENTS; e++) dumpHex(statEvents[e]);
+    dumpHex(kbTxQueue.highWater);
+    dumpHex(kbTxQueue.overflows);
+    dumpCode(SCAN_RETURN);
+
+    uint16_t chatter = 0;
+    for(uint16_t u = 0; u < 256; u++) {
+        if(!keyChatter[u]) continue;
+
+        if(chatter++ == STATS_CHATTER_MAX) {
+            for(uint8_t i = 0; i < 3; i++) dumpCode(SCAN_PERIOD);
+            break;
+        }
+        dumpHex(u);
+        dumpHex(keyChatter[u]);
+    }
+    if(chatter) dumpCode(SCAN_RETURN);
+}
+
+// Hand the dump to the macro engine as it makes room.
+void statsTask(void) {
+    while(dumpPos < dumpLen && macroTap(dumpCodes[dumpPos])) dumpPos++;
+}
@@ -0,0 +1,86 @@
+// Latency histograms and event counters.
+
+#ifndef _STATS_H_INCLUDED
+#define _STATS_H_INCLUDED
+
+#include <stdint.h>
+#include "pico/time.h"
+
+// A stage is only recorded from one core, and from either its main loop or
+// its interrupts, never both, so the unlocked updates can't race. The one
+// exception is STAT_ENQUEUE: kbSend runs from the main loop and from alarms,
+// so it's recorded with interrupts masked.
+typedef enum {
+    STAT_REPORT = 0,    // HID report arrival to handled, time queued included
+    STAT_TRANSLATE,     // handleKey
+    STAT_ENQUEUE,       // kbSend
+    STAT_MOUSE_POLL,    // MSCTRL poll to first mouse byte (core1)
+    STAT_TUH_TASK,      // One tuh_task() call
+    STAT_WAKE,          // USB interrupt to the main loop getting round to it
+    STAT_PAD,           // Gamepad report arrival to joystick pins set
+    STAT_STAGES
+} statStage_t;
+
+typedef enum {
+    STAT_EVT_REPORTS = 0,
+    STAT_EVT_KEYS,
+    STAT_EVT_MOUSE_REPORTS,
+    STAT_EVT_MOUSE_POLLS,
+    STAT_EVT_KEYS_HELD,         // Host stopped key data
+    STAT_EVT_UNKNOWN_CMDS,      // Host command bytes with no handler
+    STAT_EVT_SLEEPS,            // Times the main loop went idle
+    STAT_EVT_IDLE_MS,           // Total time spent idle, not a count
+    STAT_EVT_BOOT_KEY_MS,       // Power-on to the first scan code sent (core1)
+    STAT_EVT_MOUNT_KEY_MS,      // Latest HID mount to the next scan code sent (core1)
+    STAT_EVT_TYPED_CHARS,       // Characters typed from a USB stick
+    STAT_EVT_TYPE_DROPS,        // Characters in the file with no X68000 key
+    STAT_EVT_TYPE_CPS,          // Characters per second of the last file typed
+    STAT_EVT_REMOTE_FRAMES,     // Serial remote batches applied
+    STAT_EVT_REMOTE_BAD,        // Serial remote batches thrown away
+    STAT_EVT_REMOTE_EVENTS,     // Serial remote events applied
+    STAT_EVT_KEY_CHATTER,       // Key edges held back by debounce
+    STAT_EVT_REPORT_OVERFLOWS,  // HID reports handled early because the queue was full
+    STAT_EVT_REPORT_QUEUE_HIGH, // Most HID reports ever waiting, not a count
+    STAT_EVT_REPORT_HZ,         // Best one second report rate of any interface, not a count
+    STAT_EVENTS
+} statEvent_t;
+
+// Bucket n holds times of 2^(n-1) to 2^n - 1 microseconds, the last one everything longer.
+#define STAT_BUCKETS 16
+
+typedef struct {
+    uint32_t count;
+    uint32_t maxUs;
+    uint32_t buckets[STAT_BUCKETS];
+} statHist_t;
+
+extern statHist_t statHists[STAT_STAGES];
+extern uint32_t statEvents[STAT_EVENTS];
+
+static inline uint64_t statNow(void) {
+    return time_us_64();
+}
+
+static inline void statRecord(statStage_t stage, uint32_t us) {
+    statHist_t *h = &statHists[stage];
+    uint8_t bucket = us ? 32 - __builtin_clz(us) : 0;
+    if(bucket >= STAT_BUCKETS) bucket = STAT_BUCKETS - 1;
+
+    h->buckets[bucket]++;
+    h->count++;
+    if(us > h->maxUs) h->maxUs = us;
+}
+
+static inline void statSince(statStage_t stage, uint64_t start) {
+    statRecord(stage, (uint32_t)(time_us_64() - start));
+}
+
+static inline void statCount(statEvent_t event) {
+    statEvents[event]++;
+}
+
+// Type a summary into the X68000 as hex. Output is fed from statsTask().
+void statsDump(void);
+void statsTask(void);
+
+#endif
@@ -0,0 +1,51 @@
+// Pico's on-board LED, played out in the background.
+//
+// Patterns are stepped by an alarm, so starting one costs next to nothing,
+// even from inside a TinyUSB callback. The alarm only exists while a pattern
+// is playing, so an idle LED never wakes the main loop.
+
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include "status_led.h"
+
+const statusLedPattern_t statusLedBlink = { 0x555, 12, 20 };
+const statusLedPattern_t statusLedLittleBlink = { 0x1, 2, 30 };
+
+static const statusLedPattern_t *playing = NULL;
+static uint8_t step = 0;
+static alarm_id_t stepAlarm = 0;
+
+static int64_t stepFire(alarm_id_t id, void *userData) {
+    if(id != stepAlarm) return 0;
+
+    if(++step >= playing->steps) {
+        gpio_put(PICO_DEFAULT_LED_PIN, 0);
+        stepAlarm = 0;
+        playing = NULL;
+        return 0;
+    }
+
+    gpio_put(PICO_DEFAULT_LED_PIN, (playing->bits >> step) & 1);
+    return playing->stepMs * 1000;
+}
+
+void statusLedInit(void) {
+    gpio_init(PICO_DEFAULT_LED_PIN);
+    gpio_set_dir(PICO_DEFAULT_LED_PIN, GPIO_OUT);
+}
+
+void statusLedPlay(const statusLedPattern_t *pattern) {
+    if(!pattern->steps) return;
+
+    // The alarm fires in interrupt context on this core.
+    const uint32_t irqState = save_and_disable_interrupts();
+
+    if(stepAlarm > 0) cancel_alarm(stepAlarm);
+
+    playing = pattern;
+    step = 0;
+    gpio_put(PICO_DEFAULT_LED_PIN, pattern->bits & 1);
+    stepAlarm = add_alarm_in_ms(pattern->stepMs, stepFire, NULL, true);
+
+    restore_interrupts(irqState);
+}
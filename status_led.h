@@ -0,0 +1,24 @@
+// Pico's on-board LED, played out in the background.
+
+#ifndef _STATUS_LED_H_INCLUDED
+#define _STATUS_LED_H_INCLUDED
+
+#include <stdint.h>
+
+// Bit n of bits is the LED during step n, oldest first.
+typedef struct {
+    uint32_t bits;
+    uint8_t steps;      // At most 32
+    uint8_t stepMs;
+} statusLedPattern_t;
+
+// Six quick flashes, and one slower one.
+extern const statusLedPattern_t statusLedBlink;
+extern const statusLedPattern_t statusLedLittleBlink;
+
+void statusLedInit(void);
+
+// Start a pattern and return straight away. Cuts short whatever was playing.
+void statusLedPlay(const statusLedPattern_t *pattern);
+
+#endif
@@ -0,0 +1,195 @@
+// The key bitmap diff against the 6-slot nested scan it replaced.
+//
+// Both run the same stream of boot reports through the real handleKey:
+// typing with rollover, up to five keys held and a modifier now and then.
+// They must produce the same scan codes, and the bitmap must not be slower.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sim.h"
+#include "tusb.h"
+#include "PicoX68Key.h"
+#include "x68k_port.h"
+#include "keystate.h"
+#include "layout.h"
+
+#define REPORTS 4096
+#define ROUNDS 50
+
+//--------------------------------------------------------------------+
+// The old implementation, from hid_app.c before the bitmap. Left GUI's
+// setSpecial() calls are gone, handleKey does that through the layers now.
+//--------------------------------------------------------------------+
+
+static inline bool find_key_in_report(hid_keyboard_report_t const *report, uint8_t keycode)
+{
+  for(uint8_t i=0; i<6; i++)
+  {
+    if (report->keycode[i] == keycode)  return true;
+  }
+
+  return false;
+}
+
+static hid_keyboard_report_t prev_report = { 0, 0, {0} }; // previous report to check key released
+
+static void process_kbd_report(hid_keyboard_report_t const *report)
+{
+  for(uint8_t i=0; i<6; i++)
+  {
+
+    if ( prev_report.keycode[i] ) {
+      if( !find_key_in_report(report, prev_report.keycode[i]) ) {
+        handleKey(prev_report.keycode[i], USBKEY_RELEASED);
+      }
+    }
+
+    if ( report->keycode[i] )
+    {
+      if ( find_key_in_report(&prev_report, report->keycode[i]) )
+      {
+        handleKey(report->keycode[i], USBKEY_HELD);
+      } else {
+        handleKey(report->keycode[i], USBKEY_PRESSED);
+      }
+    }
+
+  }
+
+  // Turn the modifiers byte back into scan codes, it's easier this way.
+  for(uint8_t i=0; i<8; i++) {
+    const bool is_pressed = (report->modifier >> i) & 0x01;
+    const bool was_pressed = (prev_report.modifier >> i) & 0x01;
+    const uint8_t this_code = 0xE0 + i;
+
+    if(!was_pressed && is_pressed) handleKey(this_code, USBKEY_PRESSED);
+    if(was_pressed && !is_pressed) handleKey(this_code, USBKEY_RELEASED);
+    if(was_pressed && is_pressed) handleKey(this_code, USBKEY_HELD);
+  }
+
+  prev_report = *report;
+}
+
+//--------------------------------------------------------------------+
+// Bench
+//--------------------------------------------------------------------+
+
+static hid_keyboard_report_t reports[REPORTS];
+
+// One change per report, so the two can't differ in the order they emit.
+static void makeReports(void) {
+    static const uint8_t usages[] = { 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x15, 0x16, 0x17, 0x2C };
+    uint8_t held[5];
+    uint8_t heldCount = 0;
+    uint8_t modifier = 0;
+    uint32_t seed = 1;
+
+    for(uint32_t r = 0; r < REPORTS; r++) {
+        seed = seed * 1103515245 + 12345;
+        uint32_t pick = seed >> 16;
+
+        if(pick % 16 == 0) {
+            modifier ^= KEYBOARD_MODIFIER_LEFTSHIFT;
+        }else if(heldCount == sizeof(held) || (heldCount && pick % 3 == 0)) {
+            const uint8_t i = pick % heldCount;
+            memmove(&held[i], &held[i + 1], --heldCount - i);
+        }else{
+            uint8_t usage = usages[pick % sizeof(usages)];
+            while(memchr(held, usage, heldCount)) usage = usages[++pick % sizeof(usages)];
+            held[heldCount++] = usage;
+        }
+
+        hid_keyboard_report_t *report = &reports[r];
+        memset(report, 0, sizeof(*report));
+        report->modifier = modifier;
+        memcpy(report->keycode, held, heldCount);
+    }
+}
+
+static uint64_t wallNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Stand in for core1, which isn't running, and keep what it would have sent.
+static size_t drainKb(uint8_t *out, size_t at) {
+    while(!ringEmpty(&kbTxQueue)) {
+        const uint8_t c = ringPop(&kbTxQueue);
+        if(out) out[at] = c;
+        at++;
+    }
+    return at;
+}
+
+static void processNew(hid_keyboard_report_t const *report) {
+    keyBitmap_t keys;
+    if(keyBitmapFromBoot(&keys, report)) keyStateUpdate(&keys);
+}
+
+// One pass over the reports, keeping the scan codes if out is given.
+static size_t runOnce(void (*process)(hid_keyboard_report_t const *), uint8_t *out) {
+    size_t len = 0;
+    for(uint32_t r = 0; r < REPORTS; r++) {
+        process(&reports[r]);
+        len = drainKb(out, len);
+    }
+    return len;
+}
+
+static uint64_t timeOnce(void (*process)(hid_keyboard_report_t const *)) {
+    const uint64_t start = wallNs();
+    runOnce(process, NULL);
+    return wallNs() - start;
+}
+
+static int compareU64(const void *a, const void *b) {
+    const uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double medianPerReport(uint64_t *ns) {
+    qsort(ns, ROUNDS, sizeof(uint64_t), compareU64);
+    return (double)ns[ROUNDS / 2] / REPORTS;
+}
+
+int main(void) {
+    static uint8_t oldOut[REPORTS * 4], newOut[REPORTS * 4];
+    size_t oldLen, newLen;
+
+    layoutSelect(0);
+
+    // The old code had no debounce, and back to back reports here don't
+    // leave time for it.
+    keyStateSetDebounce(0);
+    makeReports();
+
+    oldLen = runOnce(process_kbd_report, oldOut);
+    newLen = runOnce(processNew, newOut);
+
+    // Rounds take turns, so load from anything else running lands on both
+    // alike, and the medians leave out the rounds it hit hardest.
+    static uint64_t oldRounds[ROUNDS], newRounds[ROUNDS];
+    for(uint32_t round = 0; round < ROUNDS; round++) {
+        oldRounds[round] = timeOnce(process_kbd_report);
+        newRounds[round] = timeOnce(processNew);
+    }
+    const double oldNs = medianPerReport(oldRounds);
+    const double newNs = medianPerReport(newRounds);
+
+    printf("nested scan %8.1f ns/report\n", oldNs);
+    printf("bitmap      %8.1f ns/report\n", newNs);
+    printf("%zu scan codes from %u reports\n", newLen, REPORTS);
+
+    if(!newLen || oldLen != newLen || memcmp(oldOut, newOut, newLen)) {
+        printf("scan codes differ\n");
+        return 1;
+    }
+    if(newNs > oldNs) {
+        printf("bitmap is slower\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,29 @@
+// Tiny assertions for the host tests. A failed check is reported and counted,
+// and the test carries on so one run shows everything that's wrong.
+
+#ifndef _CHECK_H_INCLUDED
+#define _CHECK_H_INCLUDED
+
+#include <stdio.h>
+
+static int checkFailures = 0;
+
+#define CHECK(cond) do { \
+    if(!(cond)) { \
+        fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+        checkFailures++; \
+    } \
+} while(0)
+
+#define CHECK_EQ(a, b) do { \
+    const long long a_ = (long long)(a), b_ = (long long)(b); \
+    if(a_ != b_) { \
+        fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, #a, #b, a_, b_); \
+        checkFailures++; \
+    } \
+} while(0)
+
+// Return value for main().
+#define CHECK_RESULT() (checkFailures ? (fprintf(stderr, "%d check(s) failed\n", checkFailures), 1) : 0)
+
+#endif
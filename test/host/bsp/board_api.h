@@ -0,0 +1,8 @@
+// Host stand-in for the TinyUSB board support the firmware uses. See sim.c.
+
+#ifndef _HOST_BSP_BOARD_API_H_INCLUDED
+#define _HOST_BSP_BOARD_API_H_INCLUDED
+
+static inline void board_init_after_tusb(void) {}
+
+#endif
@@ -0,0 +1,34 @@
+// Host stand-in for the parts of the pico-sdk the firmware uses. See sim.c.
+//
+// A transfer completes the moment it's started, into the capture buffer.
+
+#ifndef _HOST_HARDWARE_DMA_H_INCLUDED
+#define _HOST_HARDWARE_DMA_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pico/types.h"
+
+enum dma_channel_transfer_size {
+    DMA_SIZE_8 = 0,
+    DMA_SIZE_16 = 1,
+    DMA_SIZE_32 = 2
+};
+
+typedef struct {
+    uint32_t ctrl;
+} dma_channel_config;
+
+int dma_claim_unused_channel(bool required);
+dma_channel_config dma_channel_get_default_config(uint channel);
+
+static inline void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size) {}
+static inline void channel_config_set_read_increment(dma_channel_config *c, bool incr) {}
+static inline void channel_config_set_write_increment(dma_channel_config *c, bool incr) {}
+static inline void channel_config_set_dreq(dma_channel_config *c, uint dreq) {}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger);
+bool dma_channel_is_busy(uint channel);
+
+#endif
@@ -0,0 +1,22 @@
+// Host stand-in for the parts of the pico-sdk the firmware uses. See sim.c.
+//
+// Flash is an array that reads back through XIP_BASE like the real thing,
+// and erases and programs with flash semantics.
+
+#ifndef _HOST_HARDWARE_FLASH_H_INCLUDED
+#define _HOST_HARDWARE_FLASH_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define FLASH_PAGE_SIZE   256u
+#define FLASH_SECTOR_SIZE 4096u
+#define PICO_FLASH_SIZE_BYTES (2u * 1024 * 1024)
+
+extern uint8_t simFlash[PICO_FLASH_SIZE_BYTES];
+#define XIP_BASE ((uintptr_t)simFlash)
+
+void flash_range_erase(uint32_t flash_offs, size_t count);
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count);
+
+#endif
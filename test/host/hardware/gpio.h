@@ -0,0 +1,27 @@
+// Host stand-in for the parts of the pico-sdk the firmware uses. See sim.c.
+
+#ifndef _HOST_HARDWARE_GPIO_H_INCLUDED
+#define _HOST_HARDWARE_GPIO_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+
+enum gpio_function {
+    GPIO_FUNC_UART = 2,
+    GPIO_FUNC_PIO0 = 6,
+    GPIO_FUNC_SIO = 5,
+};
+
+#define GPIO_OUT 1
+#define GPIO_IN 0
+
+void gpio_init(unsigned gpio);
+void gpio_init_mask(uint32_t mask);
+void gpio_set_function(unsigned gpio, enum gpio_function fn);
+void gpio_set_dir(unsigned gpio, bool out);
+void gpio_set_dir_out_masked(uint32_t mask);
+void gpio_put(unsigned gpio, bool value);
+void gpio_put_masked(uint32_t mask, uint32_t value);
+bool gpio_get(unsigned gpio);
+
+#endif
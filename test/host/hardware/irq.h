@@ -0,0 +1,21 @@
+// Host stand-in for the parts of the pico-sdk the firmware uses. See sim.c.
+
+#ifndef _HOST_HARDWARE_IRQ_H_INCLUDED
+#define _HOST_HARDWARE_IRQ_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef void (*irq_handler_t)(void);
+
+#define USBCTRL_IRQ 5
+
+#define PICO_HIGHEST_IRQ_PRIORITY 0x00
+#define PICO_SHARED_IRQ_HANDLER_HIGHEST_ORDER_PRIORITY 0xFF
+
+void irq_set_exclusive_handler(unsigned num, irq_handler_t handler);
+void irq_add_shared_handler(unsigned num, irq_handler_t handler, uint8_t order_priority);
+void irq_set_priority(unsigned num, uint8_t hardware_priority);
+void irq_set_enabled(unsigned num, bool enabled);
+
+#endif
@@ -0,0 +1,25 @@
+// Host stand-in for the parts of the pico-sdk the firmware uses. See sim.c.
+
+#ifndef _HOST_HARDWARE_PIO_H_INCLUDED
+#define _HOST_HARDWARE_PIO_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pico/types.h"
+
+typedef struct {
+    volatile uint32_t txf[4];
+} pio_hw_t;
+
+typedef pio_hw_t *PIO;
+
+typedef struct {
+    const uint16_t *instructions;
+    uint8_t length;
+    int8_t origin;
+} pio_program_t;
+
+bool pio_claim_free_sm_and_add_program(const pio_program_t *program, PIO *pio, uint *sm, uint *offset);
+uint pio_get_dreq(PIO pio, uint sm, bool is_tx);
+
+#endif
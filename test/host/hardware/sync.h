@@ -0,0 +1,28 @@
+// Host stand-in for the parts of the pico-sdk the firmware uses. See sim.c.
+//
+// Only one core (or interrupt) ever runs at a time in the simulation, so
+// masking interrupts and spin locks have nothing to do.
+
+#ifndef _HOST_HARDWARE_SYNC_H_INCLUDED
+#define _HOST_HARDWARE_SYNC_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef volatile uint32_t spin_lock_t;
+
+static inline uint32_t save_and_disable_interrupts(void) { return 0; }
+static inline void restore_interrupts(uint32_t status) {}
+
+int spin_lock_claim_unused(bool required);
+spin_lock_t *spin_lock_init(unsigned lock_num);
+static inline uint32_t spin_lock_blocking(spin_lock_t *lock) { return 0; }
+static inline void spin_unlock(spin_lock_t *lock, uint32_t saved_irq) {}
+
+static inline void __dmb(void) { __sync_synchronize(); }
+
+// Cores hand over to each other here.
+void __wfe(void);
+void __sev(void);
+
+#endif
@@ -0,0 +1,36 @@
+// Host stand-in for the parts of the pico-sdk the firmware uses. See sim.c.
+//
+// Both UARTs are modelled as a PL011 would behave on the wire: FIFOs, a
+// shift register per direction and real bit timing.
+
+#ifndef _HOST_HARDWARE_UART_H_INCLUDED
+#define _HOST_HARDWARE_UART_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct simUart uart_inst_t;
+
+extern uart_inst_t simUart0, simUart1;
+#define uart0 (&simUart0)
+#define uart1 (&simUart1)
+
+#define UART0_IRQ 20
+#define UART1_IRQ 21
+
+typedef enum {
+    UART_PARITY_NONE,
+    UART_PARITY_EVEN,
+    UART_PARITY_ODD
+} uart_parity_t;
+
+unsigned uart_init(uart_inst_t *uart, unsigned baudrate);
+void uart_set_format(uart_inst_t *uart, unsigned data_bits, unsigned stop_bits, uart_parity_t parity);
+void uart_set_fifo_enabled(uart_inst_t *uart, bool enabled);
+void uart_set_irq_enables(uart_inst_t *uart, bool rx_has_data, bool tx_needs_data);
+bool uart_is_writable(uart_inst_t *uart);
+bool uart_is_readable(uart_inst_t *uart);
+void uart_putc_raw(uart_inst_t *uart, char c);
+char uart_getc(uart_inst_t *uart);
+
+#endif
@@ -0,0 +1,14 @@
+// Host stand-in for the parts of the pico-sdk the firmware uses. See sim.c.
+
+#ifndef _HOST_PICO_FLASH_H_INCLUDED
+#define _HOST_PICO_FLASH_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pico/types.h"
+
+// Both cores stop for as long as the flash operations in func would take.
+int flash_safe_execute(void (*func)(void *), void *param, uint32_t enter_exit_timeout_ms);
+bool flash_safe_execute_core_init(void);
+
+#endif
@@ -0,0 +1,8 @@
+// Host stand-in for the parts of the pico-sdk the firmware uses. See sim.c.
+
+#ifndef _HOST_PICO_MULTICORE_H_INCLUDED
+#define _HOST_PICO_MULTICORE_H_INCLUDED
+
+void multicore_launch_core1(void (*entry)(void));
+
+#endif
@@ -0,0 +1,24 @@
+// Host stand-in for the parts of the pico-sdk the firmware uses. See sim.c.
+
+#ifndef _HOST_PICO_STDLIB_H_INCLUDED
+#define _HOST_PICO_STDLIB_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "pico/types.h"
+#include "pico/time.h"
+#include "hardware/gpio.h"
+#include "hardware/uart.h"
+#include "hardware/sync.h"
+
+#define PICO_DEFAULT_LED_PIN 25
+
+#define count_of(a) (sizeof(a) / sizeof((a)[0]))
+
+#define __not_in_flash_func(f) f
+#define __time_critical_func(f) f
+
+static inline void tight_loop_contents(void) {}
+
+#endif
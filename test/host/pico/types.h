@@ -0,0 +1,10 @@
+// Host stand-in for the parts of the pico-sdk the firmware uses. See sim.c.
+
+#ifndef _HOST_PICO_TYPES_H_INCLUDED
+#define _HOST_PICO_TYPES_H_INCLUDED
+
+typedef unsigned int uint;
+
+#define PICO_OK 0
+
+#endif
@@ -0,0 +1,1127 @@
+// Host stand-in for the RP2040, pico-sdk and TinyUSB.
+//
+// A discrete event simulation on one virtual clock, so a run takes no longer
+// than the code itself does and always comes out the same. Alarms, the UARTs
+// (bit by bit on the wire), USB transfers and flash lockouts are the events.
+//
+// Each core runs the real firmware on a thread of its own, but only one
+// thread ever runs at a time: a core runs until it waits for an event (WFE)
+// and then hands back to the scheduler. Interrupts (alarms on core0, the UART
+// on core1) are taken by the scheduler while their core is waiting, so a
+// handler never lands in the middle of the code it interrupts. Races between
+// the two are out of scope; everything downstream of them isn't.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <pthread.h>
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "pico/flash.h"
+#include "hardware/irq.h"
+#include "hardware/flash.h"
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "tusb.h"
+#include "sim.h"
+
+void simFail(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "sim: ");
+    vfprintf(stderr, fmt, args);
+    fputc('\n', stderr);
+    va_end(args);
+    exit(2);
+}
+
+static void *grow(void *p, size_t *cap, size_t count, size_t size) {
+    if(count < *cap) return p;
+    *cap = *cap ? *cap * 2 : 256;
+    p = realloc(p, *cap * size);
+    if(!p) simFail("out of memory");
+    return p;
+}
+
+//--------------------------------------------------------------------+
+// Time and cores
+//--------------------------------------------------------------------+
+
+static uint64_t nowNs = 0;
+
+uint64_t simNowNs(void) {
+    return nowNs;
+}
+
+uint64_t time_us_64(void) {
+    return nowNs / SIM_NS_PER_US;
+}
+
+uint32_t time_us_32(void) {
+    return (uint32_t)time_us_64();
+}
+
+absolute_time_t get_absolute_time(void) {
+    return time_us_64();
+}
+
+absolute_time_t make_timeout_time_ms(uint32_t ms) {
+    return time_us_64() + ms * 1000ull;
+}
+
+typedef enum {
+    CTX_SCHEDULER = 0,
+    CTX_CORE0,
+    CTX_CORE1
+} context_t;
+
+typedef struct {
+    bool started;
+    bool event;             // The WFE event register
+    uint64_t wakeNs;        // Wake by then even without an event, 0 for never
+    pthread_t thread;
+    int (*mainEntry)(void);
+    void (*entry)(void);
+} core_t;
+
+static core_t cores[2];
+
+static pthread_mutex_t batonLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t batonCond = PTHREAD_COND_INITIALIZER;
+static context_t baton = CTX_SCHEDULER;
+static __thread context_t self = CTX_SCHEDULER;
+
+// Let another context run, and wait until it's this one's turn again.
+static void handOver(context_t to) {
+    pthread_mutex_lock(&batonLock);
+    baton = to;
+    pthread_cond_broadcast(&batonCond);
+    while(baton != self) pthread_cond_wait(&batonCond, &batonLock);
+    pthread_mutex_unlock(&batonLock);
+}
+
+static void *coreThread(void *arg) {
+    core_t *core = arg;
+    self = core == &cores[0] ? CTX_CORE0 : CTX_CORE1;
+
+    pthread_mutex_lock(&batonLock);
+    while(baton != self) pthread_cond_wait(&batonCond, &batonLock);
+    pthread_mutex_unlock(&batonLock);
+
+    if(core->mainEntry) core->mainEntry(); else core->entry();
+    simFail("core%d returned", self - CTX_CORE0);
+}
+
+static void startCore(core_t *core) {
+    core->started = true;
+    core->event = true;
+    if(pthread_create(&core->thread, NULL, coreThread, core)) simFail("can't start a core thread");
+}
+
+static core_t *currentCore(void) {
+    return self == CTX_SCHEDULER ? NULL : &cores[self - CTX_CORE0];
+}
+
+static bool coreRunnable(const core_t *core) {
+    return core->started && (core->event || (core->wakeNs && nowNs >= core->wakeNs));
+}
+
+// Back to the scheduler until there's an event, or wakeNs comes round.
+static void coreWait(core_t *core, uint64_t wakeNs) {
+    core->wakeNs = wakeNs;
+    handOver(CTX_SCHEDULER);
+    core->wakeNs = 0;
+    core->event = false;
+}
+
+void __wfe(void) {
+    core_t *core = currentCore();
+    if(!core) return;
+
+    if(core->event) {
+        core->event = false;
+        return;
+    }
+    coreWait(core, 0);
+}
+
+void __sev(void) {
+    cores[0].event = true;
+    cores[1].event = true;
+}
+
+bool best_effort_wfe_or_timeout(absolute_time_t timeout) {
+    core_t *core = currentCore();
+    const uint64_t wakeNs = timeout * SIM_NS_PER_US;
+
+    if(!core || nowNs >= wakeNs) return true;
+    if(core->event) {
+        core->event = false;
+        return false;
+    }
+
+    coreWait(core, wakeNs);
+    return nowNs >= wakeNs;
+}
+
+void multicore_launch_core1(void (*entry)(void)) {
+    cores[1].entry = entry;
+    startCore(&cores[1]);
+}
+
+//--------------------------------------------------------------------+
+// Alarms
+//--------------------------------------------------------------------+
+
+#define SIM_ALARMS 64
+
+typedef struct {
+    alarm_id_t id;          // 0 when free
+    uint64_t atNs;
+    alarm_callback_t callback;
+    void *userData;
+} alarm_t;
+
+static alarm_t alarms[SIM_ALARMS];
+static alarm_id_t lastAlarmId = 0;
+
+static alarm_t *freeAlarm(void) {
+    for(uint8_t i = 0; i < SIM_ALARMS; i++) {
+        if(!alarms[i].id) return &alarms[i];
+    }
+    return NULL;
+}
+
+// Earliest first, then in the order they were added.
+static alarm_t *nextAlarm(void) {
+    alarm_t *next = NULL;
+    for(uint8_t i = 0; i < SIM_ALARMS; i++) {
+        const alarm_t *a = &alarms[i];
+        if(!a->id) continue;
+        if(!next || a->atNs < next->atNs || (a->atNs == next->atNs && a->id < next->id)) next = &alarms[i];
+    }
+    return next;
+}
+
+alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback, void *user_data, bool fire_if_past) {
+    alarm_t *a = freeAlarm();
+    if(!a) return -1;
+
+    if(++lastAlarmId <= 0) lastAlarmId = 1;
+    *a = (alarm_t){ lastAlarmId, nowNs + us * SIM_NS_PER_US, callback, user_data };
+    return a->id;
+}
+
+alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback, void *user_data, bool fire_if_past) {
+    return add_alarm_in_us(ms * 1000ull, callback, user_data, fire_if_past);
+}
+
+bool cancel_alarm(alarm_id_t id) {
+    for(uint8_t i = 0; i < SIM_ALARMS; i++) {
+        if(id > 0 && alarms[i].id == id) {
+            alarms[i].id = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+// On core0, as the SDK's default alarm pool is.
+static bool fireAlarms(void) {
+    bool fired = false;
+    alarm_t *a;
+
+    while((a = nextAlarm()) && a->atNs <= nowNs) {
+        const alarm_t due = *a;
+        a->id = 0;
+
+        const int64_t again = due.callback(due.id, due.userData);
+        if(again) {
+            alarm_t *next = freeAlarm();
+            if(!next) simFail("out of alarms");
+            *next = due;
+            next->atNs = again < 0 ? due.atNs + (uint64_t)-again * SIM_NS_PER_US : nowNs + (uint64_t)again * SIM_NS_PER_US;
+        }
+
+        cores[0].event = true;
+        fired = true;
+    }
+    return fired;
+}
+
+//--------------------------------------------------------------------+
+// Interrupts
+//--------------------------------------------------------------------+
+
+#define SIM_IRQS 32
+
+static irq_handler_t irqHandlers[SIM_IRQS];
+static bool irqEnabled[SIM_IRQS];
+static core_t *irqCore[SIM_IRQS];
+static irq_handler_t usbIrqHandler = NULL;
+
+void irq_set_exclusive_handler(unsigned num, irq_handler_t handler) {
+    irqHandlers[num] = handler;
+    irqCore[num] = currentCore();
+}
+
+void irq_add_shared_handler(unsigned num, irq_handler_t handler, uint8_t order_priority) {
+    if(num == USBCTRL_IRQ) usbIrqHandler = handler;
+}
+
+void irq_set_priority(unsigned num, uint8_t hardware_priority) {
+}
+
+void irq_set_enabled(unsigned num, bool enabled) {
+    irqEnabled[num] = enabled;
+}
+
+static void usbIrq(void) {
+    if(usbIrqHandler) usbIrqHandler();
+    cores[0].event = true;
+}
+
+//--------------------------------------------------------------------+
+// Lines and UARTs
+//--------------------------------------------------------------------+
+
+#define SIM_UART_FIFO 32
+
+struct simUart {
+    uint8_t index;
+    uint32_t baud;          // 0 until uart_init
+    uint8_t dataBits;
+    uint8_t stopBits;
+    bool fifo;
+    bool rxIrq, txIrq;
+
+    uint8_t tx[SIM_UART_FIFO];
+    uint8_t txHead, txCount;
+    bool shifting;
+    uint64_t shiftEndNs;
+    simLine_t txLine;
+
+    uint8_t rx[SIM_UART_FIFO];
+    uint8_t rxHead, rxCount;
+    bool rxTimedOut;
+    simLine_t rxLine;
+    uint64_t rxLineFreeNs;
+    simDecoder_t rxDecoder;
+
+    uint32_t overruns;
+    uint32_t framingErrors;
+};
+
+uart_inst_t simUart0 = { .index = 0 };
+uart_inst_t simUart1 = { .index = 1 };
+static uart_inst_t *const uarts[2] = { &simUart0, &simUart1 };
+
+// Start of bit n of a frame, and the middle of it.
+static uint64_t bitStart(uint64_t startNs, uint32_t n, uint32_t baud) {
+    return startNs + n * 1000000000ull / baud;
+}
+
+static uint64_t bitMiddle(uint64_t startNs, uint32_t n, uint32_t baud) {
+    return startNs + (2 * n + 1) * 1000000000ull / (2ull * baud);
+}
+
+static void lineAppend(simLine_t *line, uint64_t atNs, bool level) {
+    const bool current = line->count ? line->edges[line->count - 1].level : true;
+    if(level == current) return;
+
+    line->edges = grow(line->edges, &line->cap, line->count, sizeof(simEdge_t));
+    line->edges[line->count++] = (simEdge_t){ atNs, level };
+}
+
+// One frame, LSB first. Returns when the last stop bit ends.
+static uint64_t lineFrame(simLine_t *line, uint64_t startNs, uint8_t byte, uint32_t baud, uint8_t dataBits, uint8_t stopBits) {
+    lineAppend(line, startNs, false);
+    for(uint8_t i = 0; i < dataBits; i++) lineAppend(line, bitStart(startNs, 1 + i, baud), (byte >> i) & 1);
+    lineAppend(line, bitStart(startNs, 1 + dataBits, baud), true);
+    return bitStart(startNs, 1 + dataBits + stopBits, baud);
+}
+
+static bool lineLevel(const simLine_t *line, uint64_t atNs) {
+    size_t lo = 0, hi = line->count;
+    while(lo < hi) {
+        const size_t mid = (lo + hi) / 2;
+        if(line->edges[mid].atNs <= atNs) lo = mid + 1; else hi = mid;
+    }
+    return lo ? line->edges[lo - 1].level : true;
+}
+
+// The next falling edge that could be a start bit, if there is one.
+static bool nextStart(const simLine_t *line, simDecoder_t *d, uint64_t *startNs) {
+    while(d->edge < line->count && (line->edges[d->edge].level || line->edges[d->edge].atNs < d->idleFromNs)) d->edge++;
+    if(d->edge == line->count) return false;
+    *startNs = line->edges[d->edge].atNs;
+    return true;
+}
+
+size_t simLineDecode(const simLine_t *line, simDecoder_t *d, uint32_t baud, uint64_t untilNs, simByte_t *out, size_t max) {
+    size_t n = 0;
+    uint64_t start;
+
+    while(n < max && nextStart(line, d, &start)) {
+        const uint64_t stopNs = bitMiddle(start, 9, baud);
+        if(stopNs > untilNs) break;
+        d->edge++;
+
+        // Gone high again by the middle of the start bit: a glitch, not a frame.
+        if(lineLevel(line, bitMiddle(start, 0, baud))) {
+            d->idleFromNs = start + 1;
+            continue;
+        }
+
+        uint8_t byte = 0;
+        for(uint8_t i = 0; i < 8; i++) {
+            if(lineLevel(line, bitMiddle(start, 1 + i, baud))) byte |= 1 << i;
+        }
+
+        out[n++] = (simByte_t){ start, byte, !lineLevel(line, stopNs) };
+        d->idleFromNs = stopNs;
+    }
+    return n;
+}
+
+const simLine_t *simUartTxLine(uint8_t uart) {
+    return &uarts[uart]->txLine;
+}
+
+uint64_t simUartSend(uint8_t uart, uint64_t atNs, uint8_t byte, uint32_t baud, uint8_t stopBits) {
+    struct simUart *u = uarts[uart];
+
+    uint64_t start = atNs;
+    if(start < nowNs) start = nowNs;
+    if(start < u->rxLineFreeNs) start = u->rxLineFreeNs;
+
+    u->rxLineFreeNs = lineFrame(&u->rxLine, start, byte, baud, 8, stopBits);
+    return start;
+}
+
+uint32_t simUartOverruns(uint8_t uart) {
+    return uarts[uart]->overruns;
+}
+
+uint32_t simUartFramingErrors(uint8_t uart) {
+    return uarts[uart]->framingErrors;
+}
+
+static uint8_t fifoDepth(const struct simUart *u) {
+    return u->fifo ? SIM_UART_FIFO : 1;
+}
+
+unsigned uart_init(uart_inst_t *uart, unsigned baudrate) {
+    uart->baud = baudrate;
+    uart->dataBits = 8;
+    uart->stopBits = 1;
+    uart->fifo = true;
+    uart->rxIrq = uart->txIrq = false;
+    return baudrate;
+}
+
+void uart_set_format(uart_inst_t *uart, unsigned data_bits, unsigned stop_bits, uart_parity_t parity) {
+    if(parity != UART_PARITY_NONE) simFail("uart%u: parity isn't modelled", uart->index);
+    uart->dataBits = data_bits;
+    uart->stopBits = stop_bits;
+}
+
+void uart_set_fifo_enabled(uart_inst_t *uart, bool enabled) {
+    uart->fifo = enabled;
+}
+
+void uart_set_irq_enables(uart_inst_t *uart, bool rx_has_data, bool tx_needs_data) {
+    uart->rxIrq = rx_has_data;
+    uart->txIrq = tx_needs_data;
+}
+
+bool uart_is_writable(uart_inst_t *uart) {
+    return uart->txCount < fifoDepth(uart);
+}
+
+bool uart_is_readable(uart_inst_t *uart) {
+    return uart->rxCount > 0;
+}
+
+static void shiftNext(struct simUart *u, uint64_t atNs) {
+    if(!u->txCount) {
+        u->shifting = false;
+        return;
+    }
+
+    const uint8_t byte = u->tx[u->txHead];
+    u->txHead = (u->txHead + 1) % SIM_UART_FIFO;
+    u->txCount--;
+
+    u->shifting = true;
+    u->shiftEndNs = lineFrame(&u->txLine, atNs, byte, u->baud, u->dataBits, u->stopBits);
+}
+
+void uart_putc_raw(uart_inst_t *uart, char c) {
+    if(!uart->baud) simFail("uart%u written before uart_init", uart->index);
+    if(!uart_is_writable(uart)) simFail("uart%u written with its TX FIFO full", uart->index);
+
+    uart->tx[(uart->txHead + uart->txCount) % SIM_UART_FIFO] = c;
+    uart->txCount++;
+    if(!uart->shifting) shiftNext(uart, nowNs);
+}
+
+char uart_getc(uart_inst_t *uart) {
+    if(!uart->rxCount) simFail("uart%u read with nothing in it", uart->index);
+
+    const uint8_t c = uart->rx[uart->rxHead];
+    uart->rxHead = (uart->rxHead + 1) % SIM_UART_FIFO;
+    if(!--uart->rxCount) uart->rxTimedOut = false;
+    return c;
+}
+
+// A PL011 raises RX at 1/8 full or after 32 idle bit times with the FIFO on,
+// and for every byte with it off. TX likewise at 1/8 full, or when the
+// holding register is empty.
+static bool uartIrqPending(const struct simUart *u) {
+    const bool rx = u->rxCount && (!u->fifo || u->rxCount >= SIM_UART_FIFO / 8 || u->rxTimedOut);
+    const bool tx = u->fifo ? u->txCount <= SIM_UART_FIFO / 8 : u->txCount == 0;
+    return (u->rxIrq && rx) || (u->txIrq && tx);
+}
+
+static uint64_t rxTimeoutNs(const struct simUart *u) {
+    return bitStart(u->rxDecoder.idleFromNs, 32, u->baud);
+}
+
+// The hardware side, which carries on whatever the cores are doing.
+static void uartUpdate(struct simUart *u) {
+    while(u->shifting && u->shiftEndNs <= nowNs) shiftNext(u, u->shiftEndNs);
+
+    if(!u->baud) return;
+
+    simByte_t b;
+    while(simLineDecode(&u->rxLine, &u->rxDecoder, u->baud, nowNs, &b, 1)) {
+        if(b.framingError) u->framingErrors++;
+        if(u->rxCount == fifoDepth(u)) {
+            u->overruns++;
+            continue;
+        }
+        u->rx[(u->rxHead + u->rxCount) % SIM_UART_FIFO] = b.byte;
+        u->rxCount++;
+    }
+
+    if(u->fifo && u->rxCount && nowNs >= rxTimeoutNs(u)) u->rxTimedOut = true;
+}
+
+static uint64_t uartNextEvent(struct simUart *u) {
+    uint64_t next = UINT64_MAX;
+    if(!u->baud) return next;
+
+    if(u->shifting) next = u->shiftEndNs;
+
+    simDecoder_t peek = u->rxDecoder;
+    uint64_t start;
+    if(nextStart(&u->rxLine, &peek, &start)) {
+        const uint64_t stopNs = bitMiddle(start, 9, u->baud);
+        if(stopNs < next) next = stopNs;
+    }
+
+    if(u->fifo && u->rxCount && !u->rxTimedOut && rxTimeoutNs(u) < next) next = rxTimeoutNs(u);
+    return next;
+}
+
+static bool deliverUartIrqs(void) {
+    bool delivered = false;
+
+    for(uint8_t i = 0; i < 2; i++) {
+        const unsigned irq = UART0_IRQ + i;
+        uint32_t storm = 0;
+
+        while(irqEnabled[irq] && irqHandlers[irq] && uartIrqPending(uarts[i])) {
+            if(++storm == 1000) simFail("uart%u interrupt never cleared", i);
+            irqHandlers[irq]();
+            if(irqCore[irq]) irqCore[irq]->event = true;
+            delivered = true;
+        }
+    }
+    return delivered;
+}
+
+//--------------------------------------------------------------------+
+// Flash
+//--------------------------------------------------------------------+
+
+// Typical for the W25Q16JV on a Pico.
+#define SIM_FLASH_ERASE_NS (45 * SIM_NS_PER_MS)     // Per 4K sector
+#define SIM_FLASH_PAGE_NS  (400 * SIM_NS_PER_US)    // Per 256 byte page
+
+uint8_t simFlash[PICO_FLASH_SIZE_BYTES];
+
+static uint64_t flashCostNs = 0;
+static uint64_t lockoutEndNs = 0;
+static uint64_t lockoutTotalNs = 0;
+static uint32_t lockouts = 0;
+
+__attribute__((constructor)) static void flashBlank(void) {
+    memset(simFlash, 0xFF, sizeof(simFlash));
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count) {
+    if(flash_offs % FLASH_SECTOR_SIZE || count % FLASH_SECTOR_SIZE || flash_offs + count > sizeof(simFlash)) {
+        simFail("flash erase of %zu at 0x%x isn't whole sectors", count, flash_offs);
+    }
+    memset(&simFlash[flash_offs], 0xFF, count);
+    flashCostNs += count / FLASH_SECTOR_SIZE * SIM_FLASH_ERASE_NS;
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count) {
+    if(flash_offs % FLASH_PAGE_SIZE || count % FLASH_PAGE_SIZE || flash_offs + count > sizeof(simFlash)) {
+        simFail("flash program of %zu at 0x%x isn't whole pages", count, flash_offs);
+    }
+    for(size_t i = 0; i < count; i++) simFlash[flash_offs + i] &= data[i];
+    flashCostNs += count / FLASH_PAGE_SIZE * SIM_FLASH_PAGE_NS;
+}
+
+bool flash_safe_execute_core_init(void) {
+    return true;
+}
+
+// Everything stops until the flash is done: no interrupts on either core, and
+// neither core runs. The UARTs carry on by themselves.
+int flash_safe_execute(void (*func)(void *), void *param, uint32_t enter_exit_timeout_ms) {
+    flashCostNs = 0;
+    func(param);
+
+    lockouts++;
+    lockoutTotalNs += flashCostNs;
+    lockoutEndNs = nowNs + flashCostNs;
+
+    core_t *core = currentCore();
+    if(core) {
+        while(nowNs < lockoutEndNs) coreWait(core, lockoutEndNs);
+    }else{
+        simRunUntil(lockoutEndNs);
+    }
+    return PICO_OK;
+}
+
+uint64_t simFlashLockoutNs(void) {
+    return lockoutTotalNs;
+}
+
+uint32_t simFlashLockouts(void) {
+    return lockouts;
+}
+
+//--------------------------------------------------------------------+
+// GPIO, spin locks, PIO and DMA
+//--------------------------------------------------------------------+
+
+static uint32_t gpioOut = 0;
+static simGpioWrite_t *gpioLog = NULL;
+static size_t gpioLogCount = 0, gpioLogCap = 0;
+
+void gpio_init(unsigned gpio) {
+    gpioOut &= ~(1u << gpio);
+}
+
+void gpio_init_mask(uint32_t mask) {
+    gpioOut &= ~mask;
+}
+
+void gpio_set_function(unsigned gpio, enum gpio_function fn) {
+}
+
+void gpio_set_dir(unsigned gpio, bool out) {
+}
+
+void gpio_set_dir_out_masked(uint32_t mask) {
+}
+
+void gpio_put(unsigned gpio, bool value) {
+    if(value) gpioOut |= 1u << gpio; else gpioOut &= ~(1u << gpio);
+}
+
+void gpio_put_masked(uint32_t mask, uint32_t value) {
+    gpioOut = (gpioOut & ~mask) | (value & mask);
+
+    gpioLog = grow(gpioLog, &gpioLogCap, gpioLogCount, sizeof(simGpioWrite_t));
+    gpioLog[gpioLogCount++] = (simGpioWrite_t){ mask, value, nowNs };
+}
+
+bool gpio_get(unsigned gpio) {
+    return (gpioOut >> gpio) & 1;
+}
+
+uint32_t simGpioOut(void) {
+    return gpioOut;
+}
+
+size_t simGpioWrites(const simGpioWrite_t **writes) {
+    *writes = gpioLog;
+    return gpioLogCount;
+}
+
+static spin_lock_t spinLocks[32];
+
+int spin_lock_claim_unused(bool required) {
+    static int next = 0;
+    if(next == 32) simFail("out of spin locks");
+    return next++;
+}
+
+spin_lock_t *spin_lock_init(unsigned lock_num) {
+    return &spinLocks[lock_num];
+}
+
+static pio_hw_t pio0Hw;
+static uint8_t *capture = NULL;
+static size_t captureCount = 0, captureCap = 0;
+
+bool pio_claim_free_sm_and_add_program(const pio_program_t *program, PIO *pio, uint *sm, uint *offset) {
+    *pio = &pio0Hw;
+    *sm = 0;
+    *offset = 0;
+    return true;
+}
+
+uint pio_get_dreq(PIO pio, uint sm, bool is_tx) {
+    return 0;
+}
+
+int dma_claim_unused_channel(bool required) {
+    return 0;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel) {
+    return (dma_channel_config){ 0 };
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger) {
+    const volatile uint8_t *src = read_addr;
+    for(uint i = 0; i < transfer_count; i++) {
+        capture = grow(capture, &captureCap, captureCount, 1);
+        capture[captureCount++] = src[i];
+    }
+}
+
+bool dma_channel_is_busy(uint channel) {
+    return false;
+}
+
+size_t simCaptureBytes(const uint8_t **bytes) {
+    *bytes = capture;
+    return captureCount;
+}
+
+//--------------------------------------------------------------------+
+// USB
+//--------------------------------------------------------------------+
+
+// Time a control transfer takes, start to completion.
+#define SIM_CTRL_NS (1 * SIM_NS_PER_MS)
+
+typedef enum {
+    USB_HID_MOUNT,
+    USB_HID_UNMOUNT,
+    USB_HID_REPORT,
+    USB_CDC_MOUNT,
+    USB_CDC_UNMOUNT,
+    USB_CDC_DATA
+} usbEventKind_t;
+
+typedef struct {
+    uint8_t kind;
+    uint8_t addr;
+    uint8_t instance;
+    uint8_t itfProtocol;
+    uint16_t len;
+    uint8_t *data;
+} usbEvent_t;
+
+static usbEvent_t *usbEvents = NULL;
+static size_t usbEventCount = 0, usbEventCap = 0, usbEventNext = 0;
+
+typedef struct {
+    bool mounted;
+    bool armed;             // Firmware has asked for the next report
+    uint8_t itfProtocol;
+    uint8_t protocol;
+} hidItf_t;
+
+static hidItf_t hidItfs[CFG_TUH_DEVICE_MAX + 1][CFG_TUH_HID];
+static uint8_t defaultProtocol = HID_PROTOCOL_BOOT;
+static uint32_t unarmedReports = 0;
+
+static struct {
+    bool busy;
+    bool irqRaised;
+    uint64_t doneNs;
+    simCtrl_t entry;
+    tuh_xfer_t xfer;
+    void *buffer;
+} ctrl;
+
+static uint8_t ctrlRefuse = 0, ctrlStall = 0;
+static simCtrl_t *ctrlLog = NULL;
+static size_t ctrlLogCount = 0, ctrlLogCap = 0;
+
+static bool cdcMounted[CFG_TUH_CDC];
+static uint8_t *cdcRx = NULL;
+static size_t cdcRxCount = 0, cdcRxCap = 0, cdcRxNext = 0;
+static uint8_t cdcTx[CFG_TUH_CDC_TX_BUFSIZE];
+static size_t cdcTxCount = 0;
+static uint8_t *cdcSent = NULL;
+static size_t cdcSentCount = 0, cdcSentCap = 0;
+
+static void usbPost(uint8_t kind, uint8_t addr, uint8_t instance, uint8_t itfProtocol, const uint8_t *data, uint16_t len) {
+    usbEvents = grow(usbEvents, &usbEventCap, usbEventCount, sizeof(usbEvent_t));
+
+    uint8_t *copy = NULL;
+    if(len) {
+        copy = malloc(len);
+        if(!copy) simFail("out of memory");
+        memcpy(copy, data, len);
+    }
+
+    usbEvents[usbEventCount++] = (usbEvent_t){ kind, addr, instance, itfProtocol, len, copy };
+    usbIrq();
+}
+
+static hidItf_t *hidItf(uint8_t addr, uint8_t instance) {
+    if(addr > CFG_TUH_DEVICE_MAX || instance >= CFG_TUH_HID) simFail("no such HID interface %u/%u", addr, instance);
+    return &hidItfs[addr][instance];
+}
+
+void simHidMount(uint8_t addr, uint8_t instance, uint8_t itfProtocol, const uint8_t *desc, uint16_t len) {
+    usbPost(USB_HID_MOUNT, addr, instance, itfProtocol, desc, len);
+}
+
+void simHidUnmount(uint8_t addr, uint8_t instance) {
+    usbPost(USB_HID_UNMOUNT, addr, instance, 0, NULL, 0);
+}
+
+void simHidReport(uint8_t addr, uint8_t instance, const uint8_t *report, uint16_t len) {
+    usbPost(USB_HID_REPORT, addr, instance, 0, report, len);
+}
+
+uint32_t simHidUnarmedReports(void) {
+    return unarmedReports;
+}
+
+void simCdcMount(uint8_t idx) {
+    usbPost(USB_CDC_MOUNT, 0, idx, 0, NULL, 0);
+}
+
+void simCdcUnmount(uint8_t idx) {
+    usbPost(USB_CDC_UNMOUNT, 0, idx, 0, NULL, 0);
+}
+
+void simCdcSend(const uint8_t *bytes, size_t len) {
+    while(len) {
+        const uint16_t chunk = len > 64 ? 64 : len;
+        usbPost(USB_CDC_DATA, 0, 0, 0, bytes, chunk);
+        bytes += chunk;
+        len -= chunk;
+    }
+}
+
+size_t simCdcReceived(const uint8_t **bytes) {
+    *bytes = cdcSent;
+    return cdcSentCount;
+}
+
+size_t simCtrlLog(const simCtrl_t **log) {
+    *log = ctrlLog;
+    return ctrlLogCount;
+}
+
+void simCtrlRefuse(uint8_t count) {
+    ctrlRefuse = count;
+}
+
+void simCtrlStall(uint8_t count) {
+    ctrlStall = count;
+}
+
+bool tuh_init(uint8_t rhport) {
+    return true;
+}
+
+void tuh_hid_set_default_protocol(uint8_t protocol) {
+    defaultProtocol = protocol;
+}
+
+uint8_t tuh_hid_interface_protocol(uint8_t dev_addr, uint8_t idx) {
+    return hidItf(dev_addr, idx)->itfProtocol;
+}
+
+uint8_t tuh_hid_get_protocol(uint8_t dev_addr, uint8_t idx) {
+    return hidItf(dev_addr, idx)->protocol;
+}
+
+bool tuh_hid_itf_get_info(uint8_t dev_addr, uint8_t idx, tuh_itf_info_t *info) {
+    if(!hidItf(dev_addr, idx)->mounted) return false;
+    info->daddr = dev_addr;
+    info->desc.bInterfaceNumber = idx;
+    return true;
+}
+
+bool tuh_hid_receive_report(uint8_t dev_addr, uint8_t idx) {
+    hidItf_t *itf = hidItf(dev_addr, idx);
+    if(!itf->mounted || itf->armed) return false;
+    itf->armed = true;
+    return true;
+}
+
+// TinyUSB runs one control transfer at a time, across every device.
+static bool ctrlStart(uint8_t kind, uint8_t addr, uint8_t instance, uint8_t value, void *buffer, uint16_t len) {
+    if(ctrl.busy || !hidItf(addr, instance)->mounted) return false;
+    if(ctrlRefuse) {
+        ctrlRefuse--;
+        return false;
+    }
+
+    ctrl.busy = true;
+    ctrl.irqRaised = false;
+    ctrl.doneNs = nowNs + SIM_CTRL_NS;
+    ctrl.entry = (simCtrl_t){ kind, addr, instance, value, XFER_RESULT_SUCCESS, len > 8 ? 8 : len };
+    ctrl.buffer = buffer;
+    return true;
+}
+
+bool tuh_control_xfer(tuh_xfer_t *xfer) {
+    if(xfer->setup->bRequest != HID_REQ_CONTROL_SET_IDLE) simFail("unexpected control request 0x%02x", xfer->setup->bRequest);
+    if(!ctrlStart(SIM_CTRL_SET_IDLE, xfer->daddr, xfer->setup->wIndex, xfer->setup->wValue, NULL, 0)) return false;
+    ctrl.xfer = *xfer;
+    return true;
+}
+
+bool tuh_hid_set_protocol(uint8_t dev_addr, uint8_t idx, uint8_t protocol) {
+    return ctrlStart(SIM_CTRL_SET_PROTOCOL, dev_addr, idx, protocol, NULL, 0);
+}
+
+bool tuh_hid_set_report(uint8_t dev_addr, uint8_t idx, uint8_t report_id, uint8_t report_type, void *report, uint16_t len) {
+    return ctrlStart(SIM_CTRL_SET_REPORT, dev_addr, idx, report_id, report, len);
+}
+
+// The buffer is read as it would be on the bus, at the end.
+static void ctrlComplete(void) {
+    simCtrl_t e = ctrl.entry;
+    ctrl.busy = false;
+
+    e.atNs = nowNs;
+    if(ctrlStall) {
+        ctrlStall--;
+        e.result = XFER_RESULT_STALLED;
+    }
+    if(ctrl.buffer) memcpy(e.data, ctrl.buffer, e.len);
+
+    ctrlLog = grow(ctrlLog, &ctrlLogCap, ctrlLogCount, sizeof(simCtrl_t));
+    ctrlLog[ctrlLogCount++] = e;
+
+    hidItf_t *itf = hidItf(e.addr, e.instance);
+
+    switch(e.kind) {
+        case SIM_CTRL_SET_IDLE:
+            ctrl.xfer.result = e.result;
+            ctrl.xfer.complete_cb(&ctrl.xfer);
+        break;
+
+        case SIM_CTRL_SET_PROTOCOL:
+            if(e.result == XFER_RESULT_SUCCESS) itf->protocol = e.value;
+            tuh_hid_set_protocol_complete_cb(e.addr, e.instance, itf->protocol);
+        break;
+
+        case SIM_CTRL_SET_REPORT:
+            tuh_hid_set_report_complete_cb(e.addr, e.instance, e.value, HID_REPORT_TYPE_OUTPUT,
+                                           e.result == XFER_RESULT_SUCCESS ? e.len : 0);
+        break;
+    }
+}
+
+static void usbDeliver(const usbEvent_t *e) {
+    switch(e->kind) {
+        case USB_HID_MOUNT: {
+            hidItf_t *itf = hidItf(e->addr, e->instance);
+            *itf = (hidItf_t){ true, false, e->itfProtocol, defaultProtocol };
+            tuh_hid_mount_cb(e->addr, e->instance, e->data, e->len);
+        }
+        break;
+
+        case USB_HID_UNMOUNT:
+            hidItf(e->addr, e->instance)->mounted = false;
+
+            // A transfer to a device that's gone never completes.
+            if(ctrl.busy && ctrl.entry.addr == e->addr) ctrl.busy = false;
+            tuh_hid_umount_cb(e->addr, e->instance);
+        break;
+
+        case USB_HID_REPORT: {
+            hidItf_t *itf = hidItf(e->addr, e->instance);
+            if(!itf->mounted) break;
+            if(!itf->armed) {
+                unarmedReports++;
+                break;
+            }
+            itf->armed = false;
+            tuh_hid_report_received_cb(e->addr, e->instance, e->data, e->len);
+        }
+        break;
+
+        case USB_CDC_MOUNT:
+            cdcMounted[e->instance] = true;
+            tuh_cdc_mount_cb(e->instance);
+        break;
+
+        case USB_CDC_UNMOUNT:
+            cdcMounted[e->instance] = false;
+            tuh_cdc_umount_cb(e->instance);
+        break;
+
+        case USB_CDC_DATA:
+            for(uint16_t i = 0; i < e->len; i++) {
+                cdcRx = grow(cdcRx, &cdcRxCap, cdcRxCount, 1);
+                cdcRx[cdcRxCount++] = e->data[i];
+            }
+        break;
+    }
+}
+
+static bool ctrlDue(void) {
+    return ctrl.busy && nowNs >= ctrl.doneNs;
+}
+
+bool tuh_task_event_ready(void) {
+    return usbEventNext != usbEventCount || ctrlDue();
+}
+
+void tuh_task(void) {
+    if(ctrlDue()) ctrlComplete();
+
+    while(usbEventNext != usbEventCount) {
+        usbEvent_t *e = &usbEvents[usbEventNext++];
+        usbDeliver(e);
+        free(e->data);
+        e->data = NULL;
+    }
+}
+
+bool tuh_cdc_mounted(uint8_t idx) {
+    return idx < CFG_TUH_CDC && cdcMounted[idx];
+}
+
+uint32_t tuh_cdc_read(uint8_t idx, void *buffer, uint32_t bufsize) {
+    uint32_t n = cdcRxCount - cdcRxNext;
+    if(n > bufsize) n = bufsize;
+    memcpy(buffer, &cdcRx[cdcRxNext], n);
+    cdcRxNext += n;
+    return n;
+}
+
+uint32_t tuh_cdc_write_available(uint8_t idx) {
+    return sizeof(cdcTx) - cdcTxCount;
+}
+
+uint32_t tuh_cdc_write(uint8_t idx, const void *buffer, uint32_t bufsize) {
+    uint32_t n = tuh_cdc_write_available(idx);
+    if(n > bufsize) n = bufsize;
+    memcpy(&cdcTx[cdcTxCount], buffer, n);
+    cdcTxCount += n;
+    return n;
+}
+
+uint32_t tuh_cdc_write_flush(uint8_t idx) {
+    const uint32_t n = cdcTxCount;
+    for(uint32_t i = 0; i < n; i++) {
+        cdcSent = grow(cdcSent, &cdcSentCap, cdcSentCount, 1);
+        cdcSent[cdcSentCount++] = cdcTx[i];
+    }
+    cdcTxCount = 0;
+    return n;
+}
+
+// No USB stick is ever plugged in.
+uint32_t tuh_msc_get_block_size(uint8_t dev_addr, uint8_t lun) {
+    return 0;
+}
+
+bool tuh_msc_read10(uint8_t dev_addr, uint8_t lun, void *buffer, uint32_t lba, uint16_t block_count,
+                    tuh_msc_complete_cb_t complete_cb, uintptr_t arg) {
+    return false;
+}
+
+//--------------------------------------------------------------------+
+// Scheduler
+//--------------------------------------------------------------------+
+
+// Run whatever is due now until both cores are waiting with nothing to do.
+static void settle(void) {
+    for(uint32_t pass = 0; ; pass++) {
+        if(pass == 1000000) simFail("firmware never went idle at %llu ns", (unsigned long long)nowNs);
+
+        for(uint8_t i = 0; i < 2; i++) uartUpdate(uarts[i]);
+        if(nowNs < lockoutEndNs) return;
+
+        if(ctrlDue() && !ctrl.irqRaised) {
+            ctrl.irqRaised = true;
+            usbIrq();
+        }
+
+        bool progress = fireAlarms();
+        progress |= deliverUartIrqs();
+
+        if(coreRunnable(&cores[1])) {
+            handOver(CTX_CORE1);
+            progress = true;
+        }
+        if(coreRunnable(&cores[0])) {
+            handOver(CTX_CORE0);
+            progress = true;
+        }
+
+        if(!progress) return;
+    }
+}
+
+static uint64_t nextEventNs(void) {
+    uint64_t next = UINT64_MAX;
+
+#define CONSIDER(t) do { const uint64_t t_ = (t); if(t_ > nowNs && t_ < next) next = t_; } while(0)
+
+    const alarm_t *a = nextAlarm();
+    if(a) CONSIDER(a->atNs > lockoutEndNs ? a->atNs : lockoutEndNs);
+
+    for(uint8_t i = 0; i < 2; i++) {
+        if(cores[i].started && cores[i].wakeNs) CONSIDER(cores[i].wakeNs);
+        CONSIDER(uartNextEvent(uarts[i]));
+    }
+
+    CONSIDER(lockoutEndNs);
+    if(ctrl.busy) CONSIDER(ctrl.doneNs);
+
+#undef CONSIDER
+
+    return next;
+}
+
+void simBoot(int (*entry)(void)) {
+    cores[0].mainEntry = entry;
+    startCore(&cores[0]);
+    settle();
+}
+
+void simRunUntil(uint64_t ns) {
+    settle();
+
+    for(;;) {
+        const uint64_t next = nextEventNs();
+        if(next > ns) break;
+        nowNs = next;
+        settle();
+    }
+
+    if(ns > nowNs) nowNs = ns;
+    settle();
+}
+
+void simRunFor(uint64_t ns) {
+    simRunUntil(nowNs + ns);
+}
@@ -0,0 +1,141 @@
+// Host stand-in for the RP2040, pico-sdk and TinyUSB: the test's side of it.
+
+#ifndef _SIM_H_INCLUDED
+#define _SIM_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SIM_NS_PER_US 1000ull
+#define SIM_NS_PER_MS 1000000ull
+
+// Abort the test with a message.
+void simFail(const char *fmt, ...) __attribute__((noreturn, format(printf, 1, 2)));
+
+//--------------------------------------------------------------------+
+// Time and cores
+//--------------------------------------------------------------------+
+
+uint64_t simNowNs(void);
+
+// Start the firmware's main() on core0 and run until both cores are idle.
+void simBoot(int (*entry)(void));
+
+// Let simulated time pass, running everything that falls due on the way.
+// Firmware that isn't booted can still use this for its alarms.
+void simRunUntil(uint64_t ns);
+void simRunFor(uint64_t ns);
+
+//--------------------------------------------------------------------+
+// UART lines, as the X68000 sees them
+//--------------------------------------------------------------------+
+
+#define SIM_UART_MOUSE 0    // uart0
+#define SIM_UART_KB    1    // uart1
+
+// A line idles high. Each edge is where it changes.
+typedef struct {
+    uint64_t atNs;
+    bool level;
+} simEdge_t;
+
+typedef struct {
+    simEdge_t *edges;
+    size_t count;
+    size_t cap;
+} simLine_t;
+
+// What the firmware has sent out of a UART's TX pin.
+const simLine_t *simUartTxLine(uint8_t uart);
+
+// Drive one 8N1 or 8N2 frame into a UART's RX pin, starting at atNs or as
+// soon as the previous frame is done. Returns when it actually starts.
+uint64_t simUartSend(uint8_t uart, uint64_t atNs, uint8_t byte, uint32_t baud, uint8_t stopBits);
+
+// Bytes the UART had nowhere to put, and frames with a bad stop bit.
+uint32_t simUartOverruns(uint8_t uart);
+uint32_t simUartFramingErrors(uint8_t uart);
+
+// A receiver sampling a line mid-bit, as a UART would. Framing errors are
+// bytes whose first stop bit wasn't high.
+typedef struct {
+    uint64_t startNs;
+    uint8_t byte;
+    bool framingError;
+} simByte_t;
+
+typedef struct {
+    size_t edge;            // Next edge to look at for a start bit
+    uint64_t idleFromNs;    // End of the last frame decoded
+} simDecoder_t;
+
+// Decode every frame that has ended by untilNs. Returns how many went into out.
+size_t simLineDecode(const simLine_t *line, simDecoder_t *decoder, uint32_t baud, uint64_t untilNs,
+                     simByte_t *out, size_t max);
+
+//--------------------------------------------------------------------+
+// USB
+//--------------------------------------------------------------------+
+
+// Plug in and pull out HID interfaces, and send reports from them. All of it
+// reaches the firmware from its next tuh_task(). A report sent while the
+// firmware hasn't asked for one is dropped and counted.
+void simHidMount(uint8_t addr, uint8_t instance, uint8_t itfProtocol, const uint8_t *desc, uint16_t len);
+void simHidUnmount(uint8_t addr, uint8_t instance);
+void simHidReport(uint8_t addr, uint8_t instance, const uint8_t *report, uint16_t len);
+uint32_t simHidUnarmedReports(void);
+
+typedef enum {
+    SIM_CTRL_SET_IDLE = 0,
+    SIM_CTRL_SET_PROTOCOL,
+    SIM_CTRL_SET_REPORT
+} simCtrlKind_t;
+
+// A control transfer that completed, with what was in its buffer then.
+typedef struct {
+    uint8_t kind;
+    uint8_t addr;
+    uint8_t instance;
+    uint8_t value;          // Protocol, or report ID
+    uint8_t result;         // xfer_result_t
+    uint8_t len;
+    uint8_t data[8];
+    uint64_t atNs;
+} simCtrl_t;
+
+size_t simCtrlLog(const simCtrl_t **log);
+
+// The next count attempts to start a control transfer are turned away, as
+// when EP0 is busy. The next count transfers to complete are stalled.
+void simCtrlRefuse(uint8_t count);
+void simCtrlStall(uint8_t count);
+
+// Serial adaptor. Bytes the PC sends, and bytes the firmware flushed out.
+void simCdcMount(uint8_t idx);
+void simCdcUnmount(uint8_t idx);
+void simCdcSend(const uint8_t *bytes, size_t len);
+size_t simCdcReceived(const uint8_t **bytes);
+
+//--------------------------------------------------------------------+
+// Everything else
+//--------------------------------------------------------------------+
+
+// GPIO outputs, and every gpio_put_masked() so far.
+typedef struct {
+    uint32_t mask;
+    uint32_t value;
+    uint64_t atNs;
+} simGpioWrite_t;
+
+uint32_t simGpioOut(void);
+size_t simGpioWrites(const simGpioWrite_t **writes);
+
+// Time both cores have spent stopped for flash operations.
+uint64_t simFlashLockoutNs(void);
+uint32_t simFlashLockouts(void);
+
+// Bytes DMAed out of the flight recorder's pin.
+size_t simCaptureBytes(const uint8_t **bytes);
+
+#endif
@@ -0,0 +1,201 @@
+// Host stand-in for the parts of TinyUSB's host stack the firmware uses.
+// See sim.c.
+//
+// Devices are whatever the test plugs in. Reports, mounts and control
+// transfer completions are delivered from tuh_task(), as TinyUSB does.
+
+#ifndef _HOST_TUSB_H_INCLUDED
+#define _HOST_TUSB_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define OPT_MCU_RP2040          1
+#define OPT_OS_NONE             1
+#define OPT_MODE_DEFAULT_SPEED  0
+
+#include "tusb_config.h"
+
+#define TU_ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+//--------------------------------------------------------------------+
+// HID
+//--------------------------------------------------------------------+
+
+typedef struct __attribute__((packed)) {
+    uint8_t modifier;
+    uint8_t reserved;
+    uint8_t keycode[6];
+} hid_keyboard_report_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t buttons;
+    int8_t x;
+    int8_t y;
+    int8_t wheel;
+    int8_t pan;
+} hid_mouse_report_t;
+
+enum {
+    HID_ITF_PROTOCOL_NONE = 0,
+    HID_ITF_PROTOCOL_KEYBOARD,
+    HID_ITF_PROTOCOL_MOUSE
+};
+
+enum {
+    HID_PROTOCOL_BOOT = 0,
+    HID_PROTOCOL_REPORT = 1
+};
+
+enum {
+    HID_REPORT_TYPE_INVALID = 0,
+    HID_REPORT_TYPE_INPUT,
+    HID_REPORT_TYPE_OUTPUT,
+    HID_REPORT_TYPE_FEATURE
+};
+
+enum {
+    HID_USAGE_PAGE_DESKTOP  = 0x01,
+    HID_USAGE_PAGE_KEYBOARD = 0x07,
+    HID_USAGE_PAGE_LED      = 0x08,
+    HID_USAGE_PAGE_BUTTON   = 0x09,
+    HID_USAGE_PAGE_CONSUMER = 0x0C
+};
+
+enum {
+    HID_USAGE_DESKTOP_POINTER    = 0x01,
+    HID_USAGE_DESKTOP_MOUSE      = 0x02,
+    HID_USAGE_DESKTOP_JOYSTICK   = 0x04,
+    HID_USAGE_DESKTOP_GAMEPAD    = 0x05,
+    HID_USAGE_DESKTOP_KEYBOARD   = 0x06,
+    HID_USAGE_DESKTOP_X          = 0x30,
+    HID_USAGE_DESKTOP_Y          = 0x31,
+    HID_USAGE_DESKTOP_WHEEL      = 0x38,
+    HID_USAGE_DESKTOP_HAT_SWITCH = 0x39
+};
+
+enum {
+    KEYBOARD_MODIFIER_LEFTCTRL   = 0x01,
+    KEYBOARD_MODIFIER_LEFTSHIFT  = 0x02,
+    KEYBOARD_MODIFIER_LEFTALT    = 0x04,
+    KEYBOARD_MODIFIER_LEFTGUI    = 0x08,
+    KEYBOARD_MODIFIER_RIGHTCTRL  = 0x10,
+    KEYBOARD_MODIFIER_RIGHTSHIFT = 0x20,
+    KEYBOARD_MODIFIER_RIGHTALT   = 0x40,
+    KEYBOARD_MODIFIER_RIGHTGUI   = 0x80
+};
+
+enum {
+    MOUSE_BUTTON_LEFT   = 0x01,
+    MOUSE_BUTTON_RIGHT  = 0x02,
+    MOUSE_BUTTON_MIDDLE = 0x04
+};
+
+#define HID_REQ_CONTROL_SET_IDLE 0x0A
+
+//--------------------------------------------------------------------+
+// Control transfers
+//--------------------------------------------------------------------+
+
+typedef enum {
+    XFER_RESULT_SUCCESS = 0,
+    XFER_RESULT_FAILED,
+    XFER_RESULT_STALLED,
+    XFER_RESULT_TIMEOUT,
+    XFER_RESULT_INVALID
+} xfer_result_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t bmRequestType;
+    uint8_t bRequest;
+    uint16_t wValue;
+    uint16_t wIndex;
+    uint16_t wLength;
+} tusb_control_request_t;
+
+typedef struct tuh_xfer_s tuh_xfer_t;
+typedef void (*tuh_xfer_cb_t)(tuh_xfer_t *xfer);
+
+struct tuh_xfer_s {
+    uint8_t daddr;
+    uint8_t ep_addr;
+    xfer_result_t result;
+    uint32_t actual_len;
+    const tusb_control_request_t *setup;
+    uint8_t *buffer;
+    tuh_xfer_cb_t complete_cb;
+    uintptr_t user_data;
+};
+
+typedef struct {
+    uint8_t daddr;
+    struct {
+        uint8_t bInterfaceNumber;
+    } desc;
+} tuh_itf_info_t;
+
+bool tuh_init(uint8_t rhport);
+void tuh_task(void);
+bool tuh_task_event_ready(void);
+bool tuh_control_xfer(tuh_xfer_t *xfer);
+
+void tuh_hid_set_default_protocol(uint8_t protocol);
+uint8_t tuh_hid_interface_protocol(uint8_t dev_addr, uint8_t idx);
+uint8_t tuh_hid_get_protocol(uint8_t dev_addr, uint8_t idx);
+bool tuh_hid_itf_get_info(uint8_t dev_addr, uint8_t idx, tuh_itf_info_t *info);
+bool tuh_hid_set_protocol(uint8_t dev_addr, uint8_t idx, uint8_t protocol);
+bool tuh_hid_set_report(uint8_t dev_addr, uint8_t idx, uint8_t report_id, uint8_t report_type, void *report, uint16_t len);
+bool tuh_hid_receive_report(uint8_t dev_addr, uint8_t idx);
+
+// Implemented by the firmware.
+void tuh_hid_mount_cb(uint8_t dev_addr, uint8_t idx, const uint8_t *desc_report, uint16_t desc_len);
+void tuh_hid_umount_cb(uint8_t dev_addr, uint8_t idx);
+void tuh_hid_report_received_cb(uint8_t dev_addr, uint8_t idx, const uint8_t *report, uint16_t len);
+void tuh_hid_set_protocol_complete_cb(uint8_t dev_addr, uint8_t idx, uint8_t protocol);
+void tuh_hid_set_report_complete_cb(uint8_t dev_addr, uint8_t idx, uint8_t report_id, uint8_t report_type, uint16_t len);
+
+//--------------------------------------------------------------------+
+// CDC
+//--------------------------------------------------------------------+
+
+bool tuh_cdc_mounted(uint8_t idx);
+uint32_t tuh_cdc_read(uint8_t idx, void *buffer, uint32_t bufsize);
+uint32_t tuh_cdc_write(uint8_t idx, const void *buffer, uint32_t bufsize);
+uint32_t tuh_cdc_write_flush(uint8_t idx);
+uint32_t tuh_cdc_write_available(uint8_t idx);
+
+void tuh_cdc_mount_cb(uint8_t idx);
+void tuh_cdc_umount_cb(uint8_t idx);
+
+//--------------------------------------------------------------------+
+// MSC
+//--------------------------------------------------------------------+
+
+enum {
+    MSC_CSW_STATUS_PASSED = 0,
+    MSC_CSW_STATUS_FAILED,
+    MSC_CSW_STATUS_PHASE_ERROR
+};
+
+typedef struct {
+    uint32_t signature;
+    uint32_t tag;
+    uint32_t data_residue;
+    uint8_t status;
+} msc_csw_t;
+
+typedef struct {
+    const void *cbw;
+    const msc_csw_t *csw;
+    void *scsi_data;
+    uintptr_t user_arg;
+} tuh_msc_complete_data_t;
+
+typedef bool (*tuh_msc_complete_cb_t)(uint8_t dev_addr, const tuh_msc_complete_data_t *cb_data);
+
+uint32_t tuh_msc_get_block_size(uint8_t dev_addr, uint8_t lun);
+bool tuh_msc_read10(uint8_t dev_addr, uint8_t lun, void *buffer, uint32_t lba, uint16_t block_count,
+                    tuh_msc_complete_cb_t complete_cb, uintptr_t arg);
+
+#endif
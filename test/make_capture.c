@@ -0,0 +1,105 @@
+// Makes a flight recorder capture from the simulated firmware, for replay
+// --capture to play back against a fresh one.
+//
+//     make_capture <output>
+//
+// A bit of everything goes in: a report protocol keyboard on the JP layout,
+// typing with a key held long enough to repeat, a boot mouse on a non-default
+// curve answering polls, LED commands, and a device coming and going.
+
+#include <stdio.h>
+#include "sim.h"
+#include "tusb.h"
+#include "x68k_port.h"
+#include "layout.h"
+#include "mouse.h"
+#include "recorder.h"
+
+int firmwareMain(void);
+
+static const uint8_t keyboardDescriptor[] = {
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01,
+    0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+    0x95, 0x01, 0x75, 0x08, 0x81, 0x01,
+    0x95, 0x05, 0x75, 0x01, 0x05, 0x08, 0x19, 0x01, 0x29, 0x05, 0x91, 0x02,
+    0x95, 0x01, 0x75, 0x03, 0x91, 0x01,
+    0x95, 0x06, 0x75, 0x08, 0x15, 0x00, 0x25, 0x65, 0x05, 0x07, 0x19, 0x00, 0x29, 0x65, 0x81, 0x00,
+    0xC0
+};
+
+static void at(uint64_t ms) {
+    simRunUntil(ms * SIM_NS_PER_MS);
+}
+
+static void keys(uint8_t modifier, uint8_t k0, uint8_t k1) {
+    const uint8_t r[8] = { modifier, 0, k0, k1 };
+    simHidReport(1, 0, r, sizeof(r));
+}
+
+static void mouse(int8_t dx, int8_t dy) {
+    const uint8_t r[3] = { 0, (uint8_t)dx, (uint8_t)dy };
+    simHidReport(2, 0, r, sizeof(r));
+}
+
+static void x68(uint8_t cmd) {
+    simUartSend(SIM_UART_KB, simNowNs(), cmd, KB_BAUD_RATE, 1);
+}
+
+int main(int argc, char **argv) {
+    if(argc != 2) {
+        fprintf(stderr, "usage: make_capture <output>\n");
+        return 2;
+    }
+
+    simBoot(firmwareMain);
+    layoutSelect(1);
+    mouseSetCurve(MOUSE_CURVE_LINEAR + 1);
+
+    at(10);
+    simHidMount(1, 0, HID_ITF_PROTOCOL_KEYBOARD, keyboardDescriptor, sizeof(keyboardDescriptor));
+    simHidMount(2, 0, HID_ITF_PROTOCOL_MOUSE, NULL, 0);
+    simHidMount(3, 0, HID_ITF_PROTOCOL_KEYBOARD, NULL, 0);
+
+    // Typing, with @ where JP differs, and a shifted key.
+    at(50);
+    keys(0, 0x2F, 0);
+    at(80);
+    keys(0, 0, 0);
+    at(100);
+    keys(0x02, 0, 0);
+    at(120);
+    keys(0x02, 0x04, 0);
+    at(140);
+    keys(0, 0, 0);
+
+    // CAPS LED on, and a device unplugged.
+    at(200);
+    x68(0x88);
+    simHidUnmount(3, 0);
+
+    // Held through the typematic delay, while the mouse moves and is polled.
+    at(300);
+    keys(0, 0x05, 0);
+    for(uint32_t ms = 300; ms < 1200; ms += 4) {
+        at(ms);
+        mouse((ms / 4) % 7 - 3, 2 - (ms / 4) % 5);
+        if(ms % 16 == 0) {
+            x68(0x41);
+            x68(0x40);
+        }
+    }
+    keys(0, 0, 0);
+
+    at(1300);
+    recorderFreeze();
+    at(4000);
+
+    const uint8_t *bytes;
+    const size_t n = simCaptureBytes(&bytes);
+    if(!n) simFail("nothing captured");
+
+    FILE *f = fopen(argv[1], "wb");
+    if(!f || fwrite(bytes, 1, n, f) != n || fclose(f)) simFail("can't write %s", argv[1]);
+    printf("%zu bytes\n", n);
+    return 0;
+}
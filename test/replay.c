@@ -0,0 +1,596 @@
+// Replays a trace of USB HID traffic and X68000 commands through the firmware.
+//
+//     replay <trace>
+//         Boots the firmware in the simulator, plays the trace against it in
+//         simulated time, and checks the exact bytes that come out of the
+//         keyboard and mouse UARTs against the trace's expect lines.
+//
+//     replay --capture <capture>
+//         The same, for a flight recorder capture: its HID traffic, mounts and
+//         X68000 commands are played at the times they were logged, and what
+//         the firmware sent then is what it must send now. The layout and
+//         mouse curve are set from the capture first, as they were when it
+//         was frozen.
+//
+//     replay --bench [--max-ns-report N] [--max-ns-key N] [--max-ns-mouse N] <trace>
+//         Times the translation path on this machine, in ns per call: the
+//         trace's HID reports through the report callback and hid_app_task,
+//         handleKey and handleMouse. Fails if any is over its limit.
+//
+// A trace is one command per line, # for comments, numbers in hex except
+// times and addresses:
+//
+//     at <ms>                             Run until then
+//     mount <addr> <instance> <itf protocol> [descriptor bytes]
+//     unmount <addr> <instance>
+//     hid <addr> <instance> <report bytes>
+//     x68 <bytes>                         Commands from the X68000, back to back
+//     layout <index>                      Select a layout
+//     curve <index>                       Select a mouse curve
+//     expect kb <bytes>                   Next scan codes out of the keyboard UART
+//     expect mouse <bytes>                Next bytes out of the mouse UART
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sim.h"
+#include "tusb.h"
+#include "PicoX68Key.h"
+#include "x68k_port.h"
+#include "keystate.h"
+#include "layout.h"
+#include "mouse.h"
+#include "recorder.h"
+
+#define TRACE_MAX_BYTES 512
+#define STREAM_MAX 65536
+
+int firmwareMain(void);
+void hid_app_task(void);
+
+typedef enum {
+    CMD_AT,
+    CMD_MOUNT,
+    CMD_UNMOUNT,
+    CMD_HID,
+    CMD_X68,
+    CMD_LAYOUT,
+    CMD_CURVE,
+    CMD_EXPECT_KB,
+    CMD_EXPECT_MOUSE
+} cmdKind_t;
+
+typedef struct {
+    cmdKind_t kind;
+    uint64_t atNs;
+    uint8_t addr, instance, itfProtocol;
+    uint16_t len;
+    uint8_t bytes[TRACE_MAX_BYTES];
+    int lineNo;
+} cmd_t;
+
+static cmd_t *cmds = NULL;
+static size_t cmdCount = 0;
+
+typedef struct {
+    uint8_t bytes[STREAM_MAX];
+    size_t len;
+} stream_t;
+
+static void streamAppend(stream_t *s, const uint8_t *bytes, size_t len) {
+    if(s->len + len > STREAM_MAX) simFail("stream too long");
+    memcpy(&s->bytes[s->len], bytes, len);
+    s->len += len;
+}
+
+static void streamPrint(const char *name, const stream_t *s) {
+    printf("%s:", name);
+    for(size_t i = 0; i < s->len; i++) printf(" %02x", s->bytes[i]);
+    printf("\n");
+}
+
+//--------------------------------------------------------------------+
+// Trace
+//--------------------------------------------------------------------+
+
+static uint16_t parseBytes(char *rest, uint8_t *out, const char *path, int lineNo) {
+    uint16_t n = 0;
+    for(char *tok = strtok(rest, " \t"); tok; tok = strtok(NULL, " \t")) {
+        char *end;
+        const unsigned long v = strtoul(tok, &end, 16);
+        if(*end || v > 0xFF) simFail("%s:%d: bad byte '%s'", path, lineNo, tok);
+        if(n == TRACE_MAX_BYTES) simFail("%s:%d: too many bytes", path, lineNo);
+        out[n++] = v;
+    }
+    return n;
+}
+
+static cmd_t *addCmd(cmdKind_t kind) {
+    static size_t cap = 0;
+
+    if(cmdCount == cap) {
+        cap = cap ? cap * 2 : 256;
+        cmds = realloc(cmds, cap * sizeof(cmd_t));
+        if(!cmds) simFail("out of memory");
+    }
+    cmd_t *c = &cmds[cmdCount++];
+    memset(c, 0, sizeof(*c));
+    c->kind = kind;
+    return c;
+}
+
+static void loadTrace(const char *path) {
+    FILE *f = fopen(path, "r");
+    if(!f) simFail("can't open %s", path);
+
+    char line[4096];
+    int lineNo = 0;
+
+    while(fgets(line, sizeof(line), f)) {
+        lineNo++;
+        char *hash = strchr(line, '#');
+        if(hash) *hash = 0;
+        line[strcspn(line, "\r\n")] = 0;
+
+        char word[16], what[16];
+        int used = 0;
+        if(sscanf(line, " %15s %n", word, &used) != 1) continue;
+
+        cmd_t *c = addCmd(CMD_AT);
+        c->lineNo = lineNo;
+
+        char *rest = line + used;
+        unsigned a = 0, b = 0, p = 0;
+        int more = 0;
+
+        if(!strcmp(word, "at")) {
+            c->kind = CMD_AT;
+            c->atNs = (uint64_t)(strtod(rest, NULL) * SIM_NS_PER_MS);
+        }else if(!strcmp(word, "mount") && sscanf(rest, "%u %u %u %n", &a, &b, &p, &more) == 3) {
+            c->kind = CMD_MOUNT;
+            c->itfProtocol = p;
+            c->len = parseBytes(rest + more, c->bytes, path, lineNo);
+        }else if(!strcmp(word, "unmount") && sscanf(rest, "%u %u", &a, &b) == 2) {
+            c->kind = CMD_UNMOUNT;
+        }else if(!strcmp(word, "hid") && sscanf(rest, "%u %u %n", &a, &b, &more) == 2) {
+            c->kind = CMD_HID;
+            c->len = parseBytes(rest + more, c->bytes, path, lineNo);
+        }else if(!strcmp(word, "x68")) {
+            c->kind = CMD_X68;
+            c->len = parseBytes(rest, c->bytes, path, lineNo);
+        }else if(!strcmp(word, "layout") && sscanf(rest, "%u", &a) == 1) {
+            c->kind = CMD_LAYOUT;
+            c->len = a;
+            a = 0;
+        }else if(!strcmp(word, "curve") && sscanf(rest, "%u", &a) == 1) {
+            c->kind = CMD_CURVE;
+            c->len = a;
+            a = 0;
+        }else if(!strcmp(word, "expect") && sscanf(rest, "%15s %n", what, &more) == 1 && (!strcmp(what, "kb") || !strcmp(what, "mouse"))) {
+            c->kind = strcmp(what, "kb") ? CMD_EXPECT_MOUSE : CMD_EXPECT_KB;
+            c->len = parseBytes(rest + more, c->bytes, path, lineNo);
+        }else{
+            simFail("%s:%d: don't understand '%s'", path, lineNo, line);
+        }
+
+        c->addr = a;
+        c->instance = b;
+    }
+
+    fclose(f);
+}
+
+//--------------------------------------------------------------------+
+// Flight recorder captures
+//--------------------------------------------------------------------+
+
+// Commands from the X68000 are logged when core1 reads them, half way through
+// the stop bit, so they go on the wire that much earlier.
+#define CAPTURE_RX_LEAD_NS (19 * 1000000000ull / (2 * KB_BAUD_RATE))
+
+// A capture that has dropped records is replayed from this long after boot.
+// One that hasn't starts at boot and keeps its own times.
+#define CAPTURE_START_NS (100 * SIM_NS_PER_MS)
+
+typedef struct {
+    uint64_t atNs;
+    size_t order;
+    cmd_t cmd;
+} timedCmd_t;
+
+static timedCmd_t *timed = NULL;
+static size_t timedCount = 0, timedCap = 0;
+
+static cmd_t *addTimed(uint64_t atNs, cmdKind_t kind) {
+    if(timedCount == timedCap) {
+        timedCap = timedCap ? timedCap * 2 : 1024;
+        timed = realloc(timed, timedCap * sizeof(timedCmd_t));
+        if(!timed) simFail("out of memory");
+    }
+    timedCmd_t *t = &timed[timedCount];
+    memset(t, 0, sizeof(*t));
+    t->atNs = atNs;
+    t->order = timedCount++;
+    t->cmd.kind = kind;
+    return &t->cmd;
+}
+
+static int compareTimed(const void *a, const void *b) {
+    const timedCmd_t *x = a, *y = b;
+    if(x->atNs != y->atNs) return x->atNs < y->atNs ? -1 : 1;
+    return x->order < y->order ? -1 : x->order > y->order;
+}
+
+static uint32_t le32(const uint8_t *p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+typedef struct {
+    const uint8_t *p, *end;
+    const char *path;
+} reader_t;
+
+static const uint8_t *take(reader_t *r, size_t n) {
+    if((size_t)(r->end - r->p) < n) simFail("%s: capture cut short", r->path);
+    const uint8_t *at = r->p;
+    r->p += n;
+    return at;
+}
+
+typedef struct {
+    uint8_t addr, instance, itfProtocol;
+    uint16_t len;
+    const uint8_t *desc;
+    bool mountLogged;
+} capDevice_t;
+
+static capDevice_t *findDevice(capDevice_t *devices, uint8_t count, uint8_t addr, uint8_t instance) {
+    for(uint8_t i = 0; i < count; i++) {
+        if(devices[i].addr == addr && devices[i].instance == instance) return &devices[i];
+    }
+    return NULL;
+}
+
+static void mountCmd(cmd_t *c, const capDevice_t *d) {
+    c->addr = d->addr;
+    c->instance = d->instance;
+    c->itfProtocol = d->itfProtocol;
+    c->len = d->len;
+    memcpy(c->bytes, d->desc, d->len);
+}
+
+static void loadCapture(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if(!f) simFail("can't open %s", path);
+    static uint8_t file[1 << 20];
+    const size_t size = fread(file, 1, sizeof(file), f);
+    fclose(f);
+
+    reader_t r = { file, file + size, path };
+    const uint8_t *header = take(&r, 7 + RECORDER_LOGS * 9);
+    if(memcmp(header, "X68R", 4) || header[4] != RECORDER_VERSION) simFail("%s: not a version %u capture", path, RECORDER_VERSION);
+
+    uint32_t sum = 0;
+    const uint8_t *summed = r.p;
+
+    capDevice_t devices[RECORDER_DEVICES];
+    const uint8_t deviceCount = *take(&r, 1);
+    if(deviceCount > RECORDER_DEVICES) simFail("%s: %u devices", path, deviceCount);
+    for(uint8_t i = 0; i < deviceCount; i++) {
+        const uint8_t *d = take(&r, 5);
+        devices[i] = (capDevice_t){ d[0], d[1], d[2], d[3] | d[4] << 8 };
+        if(devices[i].len > TRACE_MAX_BYTES) simFail("%s: descriptor too long", path);
+        devices[i].desc = take(&r, devices[i].len);
+    }
+
+    // The earliest log decides where the capture starts.
+    uint32_t startUs = le32(&header[7 + 1]);
+    for(uint8_t i = 1; i < RECORDER_LOGS; i++) {
+        const uint32_t base = le32(&header[7 + i * 9 + 1]);
+        if((int32_t)(base - startUs) < 0) startUs = base;
+    }
+    const uint64_t offsetNs = startUs ? CAPTURE_START_NS : 0;
+
+    for(uint8_t i = 0; i < RECORDER_LOGS; i++) {
+        const uint8_t *h = &header[7 + i * 9];
+        uint32_t us = le32(&h[1]);
+        reader_t log = { take(&r, le32(&h[5])), r.p, path };
+
+        while(log.p < log.end) {
+            const uint8_t type = *take(&log, 1);
+
+            uint32_t delta = 0;
+            uint8_t shift = 0, b;
+            do {
+                b = *take(&log, 1);
+                delta |= (uint32_t)(b & 0x7F) << shift;
+                shift += 7;
+            } while(b & 0x80);
+            us += delta;
+
+            const uint64_t atNs = (uint64_t)(uint32_t)(us - startUs) * SIM_NS_PER_US + offsetNs;
+            cmd_t *c;
+
+            switch(type) {
+                case RECORDER_HID: {
+                    const uint8_t *p = take(&log, 3);
+                    c = addTimed(atNs, CMD_HID);
+                    c->addr = p[0];
+                    c->instance = p[1];
+                    c->len = p[2];
+                    memcpy(c->bytes, take(&log, p[2]), p[2]);
+                }
+                break;
+
+                case RECORDER_KEY_TX:
+                    c = addTimed(atNs, CMD_EXPECT_KB);
+                    c->bytes[0] = *take(&log, 1);
+                    c->len = 1;
+                break;
+
+                case RECORDER_KEY_RX:
+                    c = addTimed(atNs > CAPTURE_RX_LEAD_NS ? atNs - CAPTURE_RX_LEAD_NS : 0, CMD_X68);
+                    c->bytes[0] = *take(&log, 1);
+                    c->len = 1;
+                break;
+
+                case RECORDER_MOUSE_TX:
+                    c = addTimed(atNs, CMD_EXPECT_MOUSE);
+                    memcpy(c->bytes, take(&log, 3), 3);
+                    c->len = 3;
+                break;
+
+                case RECORDER_MOUNT:
+                case RECORDER_UNMOUNT: {
+                    const uint8_t *p = take(&log, 2);
+                    capDevice_t *d = findDevice(devices, deviceCount, p[0], p[1]);
+                    if(type == RECORDER_UNMOUNT) {
+                        c = addTimed(atNs, CMD_UNMOUNT);
+                        c->addr = p[0];
+                        c->instance = p[1];
+                    }else if(d) {
+                        mountCmd(addTimed(atNs, CMD_MOUNT), d);
+                        d->mountLogged = true;
+                    }else{
+                        printf("no descriptor for %u/%u, mounted at %.3f ms\n", p[0], p[1], atNs / 1e6);
+                    }
+                }
+                break;
+
+                default:
+                    simFail("%s: unknown record type %u", path, type);
+            }
+        }
+    }
+
+    for(const uint8_t *p = summed; p < r.p; p++) sum += *p;
+    if(le32(take(&r, 4)) != sum) simFail("%s: bad checksum", path);
+
+    // As it was when frozen, which is the best guess at how it started.
+    addCmd(CMD_LAYOUT)->len = header[5];
+    addCmd(CMD_CURVE)->len = header[6];
+
+    // Plugged in before the capture starts.
+    for(uint8_t i = 0; i < deviceCount; i++) {
+        if(!devices[i].mountLogged) mountCmd(addCmd(CMD_MOUNT), &devices[i]);
+    }
+
+    qsort(timed, timedCount, sizeof(timedCmd_t), compareTimed);
+    for(size_t i = 0; i < timedCount; i++) {
+        addCmd(CMD_AT)->atNs = timed[i].atNs;
+        *addCmd(CMD_AT) = timed[i].cmd;
+    }
+}
+
+//--------------------------------------------------------------------+
+// Replay
+//--------------------------------------------------------------------+
+
+// Everything that has come out of a UART so far.
+static void decodeAll(uint8_t uart, uint32_t baud, stream_t *out) {
+    simDecoder_t decoder = { 0 };
+    simByte_t b;
+
+    while(simLineDecode(simUartTxLine(uart), &decoder, baud, simNowNs(), &b, 1)) {
+        if(b.framingError) simFail("framing error on uart%u at %llu ns", uart, (unsigned long long)b.startNs);
+        streamAppend(out, &b.byte, 1);
+    }
+}
+
+static int replay(void) {
+    static stream_t wantKb, wantMouse, gotKb, gotMouse;
+
+    simBoot(firmwareMain);
+
+    for(size_t i = 0; i < cmdCount; i++) {
+        const cmd_t *c = &cmds[i];
+
+        switch(c->kind) {
+            case CMD_AT:
+                simRunUntil(c->atNs);
+            break;
+
+            case CMD_MOUNT:
+                simHidMount(c->addr, c->instance, c->itfProtocol, c->bytes, c->len);
+            break;
+
+            case CMD_UNMOUNT:
+                simHidUnmount(c->addr, c->instance);
+            break;
+
+            case CMD_HID:
+                simHidReport(c->addr, c->instance, c->bytes, c->len);
+            break;
+
+            case CMD_X68:
+                for(uint16_t j = 0; j < c->len; j++) simUartSend(SIM_UART_KB, simNowNs(), c->bytes[j], KB_BAUD_RATE, 1);
+            break;
+
+            case CMD_LAYOUT:
+                layoutSelect(c->len);
+            break;
+
+            case CMD_CURVE:
+                mouseSetCurve(c->len);
+            break;
+
+            case CMD_EXPECT_KB:
+                streamAppend(&wantKb, c->bytes, c->len);
+            break;
+
+            case CMD_EXPECT_MOUSE:
+                streamAppend(&wantMouse, c->bytes, c->len);
+            break;
+        }
+    }
+
+    // Long enough for anything still queued at 2400 baud to get out.
+    simRunFor(2000 * SIM_NS_PER_MS);
+
+    decodeAll(SIM_UART_KB, KB_BAUD_RATE, &gotKb);
+    decodeAll(SIM_UART_MOUSE, MOUSE_BAUD_RATE, &gotMouse);
+    streamPrint("kb", &gotKb);
+    streamPrint("mouse", &gotMouse);
+
+    int failed = 0;
+    if(gotKb.len != wantKb.len || memcmp(gotKb.bytes, wantKb.bytes, gotKb.len)) {
+        streamPrint("expected kb", &wantKb);
+        failed = 1;
+    }
+    if(gotMouse.len != wantMouse.len || memcmp(gotMouse.bytes, wantMouse.bytes, gotMouse.len)) {
+        streamPrint("expected mouse", &wantMouse);
+        failed = 1;
+    }
+    if(simUartOverruns(SIM_UART_KB)) {
+        printf("%u command bytes overran the keyboard UART\n", simUartOverruns(SIM_UART_KB));
+        failed = 1;
+    }
+    return failed;
+}
+
+//--------------------------------------------------------------------+
+// Benchmark
+//--------------------------------------------------------------------+
+
+#define BENCH_MIN_CALLS 200000
+
+static uint64_t wallNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint32_t benchScanCodes = 0;
+
+// Stand in for core1, which isn't running.
+static void drainKb(void) {
+    while(!ringEmpty(&kbTxQueue)) {
+        ringPop(&kbTxQueue);
+        benchScanCodes++;
+    }
+}
+
+static double benchReports(void) {
+    size_t reports = 0;
+
+    for(size_t i = 0; i < cmdCount; i++) {
+        if(cmds[i].kind == CMD_MOUNT) simHidMount(cmds[i].addr, cmds[i].instance, cmds[i].itfProtocol, cmds[i].bytes, cmds[i].len);
+        if(cmds[i].kind == CMD_HID) reports++;
+    }
+    tuh_task();
+    if(!reports) return 0;
+
+    size_t calls = 0;
+    const uint64_t start = wallNs();
+    while(calls < BENCH_MIN_CALLS) {
+        for(size_t i = 0; i < cmdCount; i++) {
+            const cmd_t *c = &cmds[i];
+            if(c->kind != CMD_HID) continue;
+
+            tuh_hid_report_received_cb(c->addr, c->instance, c->bytes, c->len);
+            hid_app_task();
+            drainKb();
+            calls++;
+        }
+    }
+    return (double)(wallNs() - start) / calls;
+}
+
+static double benchKeys(void) {
+    static const uint8_t usages[] = { 0x04, 0x16, 0x28, 0x2C, 0x52, 0x1E };
+
+    const uint64_t start = wallNs();
+    for(uint32_t n = 0; n < BENCH_MIN_CALLS / 2; n++) {
+        const uint8_t usage = usages[n % sizeof(usages)];
+        handleKey(usage, USBKEY_PRESSED);
+        handleKey(usage, USBKEY_RELEASED);
+        drainKb();
+    }
+    return (double)(wallNs() - start) / BENCH_MIN_CALLS;
+}
+
+static double benchMouse(void) {
+    const uint64_t start = wallNs();
+    for(uint32_t n = 0; n < BENCH_MIN_CALLS; n++) {
+        handleMouse(n & MOUSE_X68_LEFT, (n & 7) - 3, 3 - (n & 3), 0);
+    }
+    return (double)(wallNs() - start) / BENCH_MIN_CALLS;
+}
+
+static int checkLimit(const char *what, double ns, double limit) {
+    printf("%-8s %8.1f ns/call (limit %.0f)\n", what, ns, limit);
+    return limit > 0 && ns > limit;
+}
+
+static int bench(double maxReport, double maxKey, double maxMouse) {
+    // As main() would, without starting anything.
+    layoutSelect(0);
+    mouseSetCurve(MOUSE_CURVE_LINEAR);
+
+    // Back to back edges would otherwise be held for the debounce window,
+    // which this doesn't let pass.
+    keyStateSetDebounce(0);
+
+    int failed = 0;
+    failed |= checkLimit("report", benchReports(), maxReport);
+    failed |= checkLimit("key", benchKeys(), maxKey);
+    failed |= checkLimit("mouse", benchMouse(), maxMouse);
+
+    // Timing a path that quietly does nothing would prove nothing.
+    if(!benchScanCodes) {
+        printf("no scan codes came out\n");
+        failed = 1;
+    }
+    return failed;
+}
+
+int main(int argc, char **argv) {
+    bool benchmark = false, capture = false;
+    double maxReport = 0, maxKey = 0, maxMouse = 0;
+    const char *path = NULL;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--bench")) {
+            benchmark = true;
+        }else if(!strcmp(argv[i], "--capture")) {
+            capture = true;
+        }else if(!strcmp(argv[i], "--max-ns-report") && i + 1 < argc) {
+            maxReport = atof(argv[++i]);
+        }else if(!strcmp(argv[i], "--max-ns-key") && i + 1 < argc) {
+            maxKey = atof(argv[++i]);
+        }else if(!strcmp(argv[i], "--max-ns-mouse") && i + 1 < argc) {
+            maxMouse = atof(argv[++i]);
+        }else{
+            path = argv[i];
+        }
+    }
+    if(!path) {
+        fprintf(stderr, "usage: replay [--bench [--max-ns-report N] [--max-ns-key N] [--max-ns-mouse N]] <trace>\n"
+                        "       replay --capture <capture>\n");
+        return 2;
+    }
+
+    if(capture) loadCapture(path); else loadTrace(path);
+    return benchmark ? bench(maxReport, maxKey, maxMouse) : replay();
+}
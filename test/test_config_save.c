@@ -0,0 +1,84 @@
+// Settings saves keep flash erases away from X68000 commands, MSCTRL polling
+// included, but don't wait for polling forever.
+
+#include "sim.h"
+#include "check.h"
+#include "x68k_port.h"
+#include "config.h"
+#include "mouse.h"
+
+#define POLL_MS 16
+
+int firmwareMain(void);
+
+// Poll the mouse like a running X68000 until untilMs.
+static void pollUntil(uint64_t untilMs) {
+    while(simNowNs() < untilMs * SIM_NS_PER_MS) {
+        simUartSend(SIM_UART_KB, simNowNs(), 0x41, KB_BAUD_RATE, 1);
+        simUartSend(SIM_UART_KB, simNowNs(), 0x40, KB_BAUD_RATE, 1);
+        simRunFor(POLL_MS * SIM_NS_PER_MS);
+    }
+}
+
+// Something that actually needs saving.
+static void change(void) {
+    mouseSetCurve((mouseGetCurve() + 1) % MOUSE_CURVE_COUNT);
+    configChanged();
+}
+
+// One command byte from the X68000 at ms.
+static void command(uint64_t ms, uint8_t cmd) {
+    simUartSend(SIM_UART_KB, ms * SIM_NS_PER_MS, cmd, KB_BAUD_RATE, 1);
+}
+
+static uint32_t lockoutsBy(uint64_t ms) {
+    simRunUntil(ms * SIM_NS_PER_MS);
+    return simFlashLockouts();
+}
+
+int main(void) {
+    simBoot(firmwareMain);
+    simRunUntil(100 * SIM_NS_PER_MS);
+    CHECK_EQ(x68kPortMsSinceCommand(), UINT32_MAX);
+
+    // First save erases a fresh sector. It waits out the polling, then goes
+    // within a second of it stopping.
+    change();
+    pollUntil(5000);
+    CHECK(x68kPortMsSinceCommand() < POLL_MS);
+    CHECK_EQ(simFlashLockouts(), 0);
+    CHECK_EQ(lockoutsBy(5900), 0);
+    CHECK_EQ(lockoutsBy(6300), 2);
+
+    // The next record goes in the same sector. Programming isn't held back.
+    change();
+    pollUntil(9000);
+    CHECK_EQ(simFlashLockouts(), 3);
+
+    // The one after that needs an erase, and the X68000 never stops polling.
+    change();
+    pollUntil(25000);
+    CHECK_EQ(simFlashLockouts(), 3);
+    pollUntil(45000);
+    CHECK_EQ(simFlashLockouts(), 5);
+
+    // Polls overran during that one. Nothing else should from here on.
+    const uint32_t overruns = simUartOverruns(SIM_UART_KB);
+
+    // Fill the sector so the next save erases.
+    change();
+    CHECK_EQ(lockoutsBy(48000), 6);
+
+    // Key data stops and starts again right as the erase was due. With the
+    // FIFO off, an erase then would drop the 0x49 and leave keys stuck.
+    change();
+    command(49950, 0x48);
+    command(50025, 0x80);
+    command(50035, 0x49);
+    CHECK_EQ(lockoutsBy(50900), 6);
+    CHECK_EQ(lockoutsBy(51300), 8);
+    CHECK_EQ(simUartOverruns(SIM_UART_KB), overruns);
+    CHECK(keyDataEnabled);
+
+    return CHECK_RESULT();
+}
@@ -0,0 +1,73 @@
+// Setup requests after mount: one that can't be queued is retried, and one
+// the device stalls is moved past.
+
+#include "sim.h"
+#include "check.h"
+#include "tusb.h"
+#include "x68k_port.h"
+
+#define SCAN_A 0x1E
+
+int firmwareMain(void);
+
+// How many of one kind of transfer a device has had, and the latest.
+static size_t ctrlCount(uint8_t addr, uint8_t kind, const simCtrl_t **last) {
+    static const simCtrl_t none = { .value = 0xFF, .result = 0xFF };
+    const simCtrl_t *log;
+    const size_t n = simCtrlLog(&log);
+    size_t count = 0;
+
+    *last = &none;
+    for(size_t i = 0; i < n; i++) {
+        if(log[i].addr != addr || log[i].kind != kind) continue;
+        *last = &log[i];
+        count++;
+    }
+    return count;
+}
+
+// Whether pressing A on a boot keyboard gets through, which it only does
+// once SET_PROTOCOL has switched it to boot.
+static bool typesA(uint8_t addr) {
+    static const uint8_t down[8] = { 0, 0, 0x04 }, up[8] = { 0 };
+    static simDecoder_t decoder;
+
+    simHidReport(addr, 0, down, sizeof(down));
+    simRunFor(20 * SIM_NS_PER_MS);
+    simHidReport(addr, 0, up, sizeof(up));
+    simRunFor(50 * SIM_NS_PER_MS);
+
+    simByte_t out[4];
+    const size_t n = simLineDecode(simUartTxLine(SIM_UART_KB), &decoder, KB_BAUD_RATE, simNowNs(), out, 4);
+    return n == 2 && out[0].byte == SCAN_A && out[1].byte == (SCAN_A | 0x80);
+}
+
+int main(void) {
+    const simCtrl_t *last;
+
+    simBoot(firmwareMain);
+
+    // EP0 turns the first few attempts away.
+    simCtrlRefuse(3);
+    simHidMount(1, 0, HID_ITF_PROTOCOL_KEYBOARD, NULL, 0);
+    simRunFor(100 * SIM_NS_PER_MS);
+
+    CHECK_EQ(ctrlCount(1, SIM_CTRL_SET_IDLE, &last), 1);
+    CHECK_EQ(ctrlCount(1, SIM_CTRL_SET_PROTOCOL, &last), 1);
+    CHECK_EQ(last->value, HID_PROTOCOL_BOOT);
+    CHECK_EQ(last->result, XFER_RESULT_SUCCESS);
+    CHECK(typesA(1));
+
+    // Plenty of keyboards stall SET_IDLE. That still moves on to SET_PROTOCOL.
+    simCtrlStall(1);
+    simHidMount(2, 0, HID_ITF_PROTOCOL_KEYBOARD, NULL, 0);
+    simRunFor(100 * SIM_NS_PER_MS);
+
+    CHECK_EQ(ctrlCount(2, SIM_CTRL_SET_IDLE, &last), 1);
+    CHECK_EQ(last->result, XFER_RESULT_STALLED);
+    CHECK_EQ(ctrlCount(2, SIM_CTRL_SET_PROTOCOL, &last), 1);
+    CHECK_EQ(last->result, XFER_RESULT_SUCCESS);
+    CHECK(typesA(2));
+
+    return CHECK_RESULT();
+}
@@ -0,0 +1,71 @@
+// LED output reports: keyboards with report IDs get the ID as the first
+// byte, keyboards without get the bare LED byte.
+
+#include <string.h>
+#include "sim.h"
+#include "check.h"
+#include "tusb.h"
+#include "x68k_port.h"
+
+int firmwareMain(void);
+
+// A plain keyboard, but with everything under report ID 1.
+static const uint8_t keyboardWithId[] = {
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x85, 0x01,
+    0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+    0x95, 0x01, 0x75, 0x08, 0x81, 0x01,
+    0x95, 0x05, 0x75, 0x01, 0x05, 0x08, 0x19, 0x01, 0x29, 0x05, 0x91, 0x02,
+    0x95, 0x01, 0x75, 0x03, 0x91, 0x01,
+    0x95, 0x06, 0x75, 0x08, 0x15, 0x00, 0x25, 0x65, 0x05, 0x07, 0x19, 0x00, 0x29, 0x65, 0x81, 0x00,
+    0xC0
+};
+
+// The last SET_REPORT to the given device.
+static const simCtrl_t *lastSetReport(uint8_t addr) {
+    const simCtrl_t *log;
+    const simCtrl_t *found = NULL;
+    const size_t n = simCtrlLog(&log);
+
+    for(size_t i = 0; i < n; i++) {
+        if(log[i].kind == SIM_CTRL_SET_REPORT && log[i].addr == addr) found = &log[i];
+    }
+    return found;
+}
+
+int main(void) {
+    simBoot(firmwareMain);
+
+    simHidMount(1, 0, HID_ITF_PROTOCOL_KEYBOARD, keyboardWithId, sizeof(keyboardWithId));
+    simHidMount(2, 0, HID_ITF_PROTOCOL_KEYBOARD, NULL, 0);
+    simRunFor(20 * SIM_NS_PER_MS);
+
+    // CAPS on.
+    simUartSend(SIM_UART_KB, simNowNs(), 0x88, KB_BAUD_RATE, 1);
+    simRunFor(50 * SIM_NS_PER_MS);
+
+    const simCtrl_t *withId = lastSetReport(1);
+    CHECK(withId);
+    if(withId) {
+        CHECK_EQ(withId->value, 1);
+        CHECK_EQ(withId->len, 2);
+        CHECK_EQ(withId->data[0], 1);
+        CHECK_EQ(withId->data[1], 2);
+    }
+
+    const simCtrl_t *bare = lastSetReport(2);
+    CHECK(bare);
+    if(bare) {
+        CHECK_EQ(bare->value, 0);
+        CHECK_EQ(bare->len, 1);
+        CHECK_EQ(bare->data[0], 2);
+    }
+
+    // Accepted, so the same LEDs again don't go out a second time.
+    const simCtrl_t *log;
+    const size_t before = simCtrlLog(&log);
+    simUartSend(SIM_UART_KB, simNowNs(), 0x88, KB_BAUD_RATE, 1);
+    simRunFor(50 * SIM_NS_PER_MS);
+    CHECK_EQ(simCtrlLog(&log), before);
+
+    return CHECK_RESULT();
+}
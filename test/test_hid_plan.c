@@ -0,0 +1,65 @@
+// Report descriptors with fields wider than 255 controls: the counts, and the
+// offsets of whatever comes after them, must survive.
+
+#include <string.h>
+#include "check.h"
+#include "hid_plan.h"
+
+// An NKRO bitmap of all 256 usages, then a 6KRO array as well.
+static const uint8_t nkroThenArray[] = {
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01,
+    0x05, 0x07, 0x19, 0x00, 0x2A, 0xFF, 0x00, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x96, 0x00, 0x01, 0x81, 0x02,
+    0x19, 0x00, 0x2A, 0xFF, 0x00, 0x15, 0x00, 0x26, 0xFF, 0x00, 0x75, 0x08, 0x95, 0x06, 0x81, 0x00,
+    0xC0
+};
+
+// 256 bits of padding ahead of the array.
+static const uint8_t paddingThenArray[] = {
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01,
+    0x75, 0x01, 0x96, 0x00, 0x01, 0x81, 0x01,
+    0x05, 0x07, 0x19, 0x00, 0x2A, 0xFF, 0x00, 0x15, 0x00, 0x26, 0xFF, 0x00, 0x75, 0x08, 0x95, 0x06, 0x81, 0x00,
+    0xC0
+};
+
+#define SCAN_A 0x04
+#define SCAN_B 0x05
+#define USAGE_LAST 0xFF
+
+int main(void) {
+    static hidPlan_t plan;
+    hidInput_t in;
+    uint8_t report[38];
+
+    CHECK(hidPlanCompile(&plan, nkroThenArray, sizeof(nkroThenArray)));
+    CHECK_EQ(plan.reportCount, 1);
+    CHECK_EQ(plan.reports[0].bitLength, 256 + 6 * 8);
+    CHECK_EQ(plan.reports[0].fieldCount, 2);
+    CHECK_EQ(plan.reports[0].fields[0].count, 256);
+    CHECK_EQ(plan.reports[0].fields[1].bitOffset, 256);
+
+    // B and the very last usage in the bitmap, A in the array.
+    memset(report, 0, sizeof(report));
+    report[SCAN_B / 8] |= 1 << (SCAN_B % 8);
+    report[USAGE_LAST / 8] |= 1 << (USAGE_LAST % 8);
+    report[32] = SCAN_A;
+    CHECK(hidPlanRun(&plan, report, sizeof(report), &in));
+    CHECK(in.hasKeys);
+    CHECK(keyBitmapTest(&in.keys, SCAN_A));
+    CHECK(keyBitmapTest(&in.keys, SCAN_B));
+    CHECK(keyBitmapTest(&in.keys, USAGE_LAST));
+
+    CHECK(hidPlanCompile(&plan, paddingThenArray, sizeof(paddingThenArray)));
+    CHECK_EQ(plan.reports[0].bitLength, 256 + 6 * 8);
+    CHECK_EQ(plan.reports[0].fieldCount, 1);
+    CHECK_EQ(plan.reports[0].fields[0].bitOffset, 256);
+
+    // Padding that happens to look like keys isn't.
+    memset(report, 0, sizeof(report));
+    report[0] = SCAN_B;
+    report[32] = SCAN_A;
+    CHECK(hidPlanRun(&plan, report, sizeof(report), &in));
+    CHECK(keyBitmapTest(&in.keys, SCAN_A));
+    CHECK(!keyBitmapTest(&in.keys, SCAN_B));
+
+    return CHECK_RESULT();
+}
@@ -0,0 +1,92 @@
+// Gamepad reports drive the joystick port: one GPIO write per report, with
+// the pins for that report, as soon as it's handled.
+
+#include "sim.h"
+#include "check.h"
+#include "tusb.h"
+#include "joystick.h"
+
+#define PAD_ADDR 3
+
+#define PIN(p) (1u << (p))
+#define JOY_MASK (PIN(JOY_PIN_UP) | PIN(JOY_PIN_DOWN) | PIN(JOY_PIN_LEFT) | PIN(JOY_PIN_RIGHT) | PIN(JOY_PIN_A) | PIN(JOY_PIN_B))
+
+int firmwareMain(void);
+
+// X and Y 0-255, a hat with a null state, four buttons.
+static const uint8_t padDescriptor[] = {
+    0x05, 0x01, 0x09, 0x05, 0xA1, 0x01,
+    0x15, 0x00, 0x26, 0xFF, 0x00, 0x75, 0x08, 0x95, 0x02, 0x09, 0x30, 0x09, 0x31, 0x81, 0x02,
+    0x15, 0x00, 0x25, 0x07, 0x75, 0x04, 0x95, 0x01, 0x09, 0x39, 0x81, 0x42,
+    0x05, 0x09, 0x19, 0x01, 0x29, 0x04, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x04, 0x81, 0x02,
+    0xC0
+};
+
+#define HAT_NONE 8
+
+typedef struct {
+    uint8_t x, y, hat, buttons;
+    uint32_t low;           // Pins expected pulled low
+} padCase_t;
+
+static const padCase_t cases[] = {
+    { 0x80, 0x80, HAT_NONE, 0, 0 },
+    { 0x00, 0x80, HAT_NONE, 0, PIN(JOY_PIN_LEFT) },
+    { 0x80, 0xFF, HAT_NONE, 0, PIN(JOY_PIN_DOWN) },
+    { 0xA0, 0x60, HAT_NONE, 0, 0 },                                 // Inside the dead zone
+    { 0x80, 0x80, 1, 0, PIN(JOY_PIN_UP) | PIN(JOY_PIN_RIGHT) },
+    { 0x80, 0x80, 6, 0x1, PIN(JOY_PIN_LEFT) | PIN(JOY_PIN_A) },
+    { 0x80, 0x80, HAT_NONE, 0x2, PIN(JOY_PIN_B) },
+    { 0x80, 0x80, HAT_NONE, 0xF, PIN(JOY_PIN_A) | PIN(JOY_PIN_B) },
+    { 0x80, 0xFF, 0, 0, 0 },                                        // Up and down cancel out
+    { 0xFF, 0x00, HAT_NONE, 0x4, PIN(JOY_PIN_UP) | PIN(JOY_PIN_RIGHT) | PIN(JOY_PIN_A) },
+};
+
+// Writes to the joystick pins from index *from on. Moves *from past them.
+static size_t joyWrites(size_t *from, const simGpioWrite_t **last) {
+    const simGpioWrite_t *writes;
+    const size_t n = simGpioWrites(&writes);
+    size_t count = 0;
+
+    for(; *from < n; (*from)++) {
+        if(writes[*from].mask != JOY_MASK) continue;
+        *last = &writes[*from];
+        count++;
+    }
+    return count;
+}
+
+int main(void) {
+    simBoot(firmwareMain);
+    simRunFor(10 * SIM_NS_PER_MS);
+
+    // All lines released at start-up.
+    size_t seen = 0;
+    const simGpioWrite_t *last = NULL;
+    CHECK_EQ(joyWrites(&seen, &last), 1);
+    CHECK_EQ(simGpioOut() & JOY_MASK, JOY_MASK);
+
+    simHidMount(PAD_ADDR, 0, HID_ITF_PROTOCOL_NONE, padDescriptor, sizeof(padDescriptor));
+    simRunFor(20 * SIM_NS_PER_MS);
+    joyWrites(&seen, &last);
+
+    for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        const padCase_t *c = &cases[i];
+        const uint8_t report[3] = { c->x, c->y, (uint8_t)(c->hat | c->buttons << 4) };
+        const uint64_t sentNs = simNowNs();
+
+        simHidReport(PAD_ADDR, 0, report, sizeof(report));
+        simRunFor(10 * SIM_NS_PER_MS);
+
+        CHECK_EQ(joyWrites(&seen, &last), 1);
+        CHECK_EQ(simGpioOut() & JOY_MASK, JOY_MASK & ~c->low);
+        if(last) CHECK(last->atNs - sentNs < SIM_NS_PER_MS);
+    }
+
+    // Unplugged with buttons down, the port lets go.
+    simHidUnmount(PAD_ADDR, 0);
+    simRunFor(10 * SIM_NS_PER_MS);
+    CHECK_EQ(simGpioOut() & JOY_MASK, JOY_MASK);
+
+    return CHECK_RESULT();
+}
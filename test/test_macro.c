@@ -0,0 +1,82 @@
+// Macro recording keeps the gaps between keys, and playback honours them.
+
+#include "pico/stdlib.h"
+#include "sim.h"
+#include "check.h"
+#include "PicoX68Key.h"
+#include "x68k_port.h"
+#include "macro.h"
+
+#define SCAN_A 0x1E
+#define SCAN_B 0x2E
+
+int firmwareMain(void);
+
+static void at(uint64_t ms) {
+    simRunUntil(ms * SIM_NS_PER_MS);
+}
+
+static int64_t never(alarm_id_t id, void *userData) {
+    return 0;
+}
+
+int main(void) {
+    simBoot(firmwareMain);
+
+    at(100);
+    macroRecordStart();
+    keyDown(SCAN_A);
+    at(150);
+    keyUp(SCAN_A);
+    at(550);        // Longer than a step can wait
+    keyDown(SCAN_B);
+    at(580);
+    keyUp(SCAN_B);
+    macroRecordStop(0);
+
+    CHECK_EQ(macroSlotLength[0], 4);
+    CHECK_EQ(macroSlots[0][0].code, SCAN_A);
+    CHECK_EQ(macroSlots[0][0].delayMs, 50);
+    CHECK_EQ(macroSlots[0][1].delayMs, 255);
+    CHECK_EQ(macroSlots[0][2].delayMs, 30);
+    CHECK_EQ(macroSlots[0][3].delayMs, 0);
+
+    // Played back, the gaps are the recorded ones, less nothing but rounding.
+    at(1000);
+    macroPlay(0);
+    at(2000);
+
+    simByte_t out[16];
+    simDecoder_t decoder = { 0 };
+    const size_t n = simLineDecode(simUartTxLine(SIM_UART_KB), &decoder, KB_BAUD_RATE, simNowNs(), out, 16);
+
+    CHECK_EQ(n, 8);
+    if(n == 8) {
+        const simByte_t *play = &out[4];
+        CHECK_EQ(play[0].byte, SCAN_A);
+        CHECK_EQ(play[3].byte, SCAN_B | 0x80);
+        CHECK_EQ((play[1].startNs - play[0].startNs) / SIM_NS_PER_MS, 50);
+        CHECK_EQ((play[2].startNs - play[1].startNs) / SIM_NS_PER_MS, 255);
+        CHECK_EQ((play[3].startNs - play[2].startNs) / SIM_NS_PER_MS, 30);
+    }
+
+    // With every alarm taken, playback can't start. It mustn't wedge either:
+    // once one is free, the next play sends both.
+    alarm_id_t taken[256];
+    uint16_t takenCount = 0;
+    while(takenCount < 256) {
+        const alarm_id_t id = add_alarm_in_ms(60000, never, NULL, true);
+        if(id <= 0) break;
+        taken[takenCount++] = id;
+    }
+    macroPlay(0);
+    at(2500);
+    for(uint16_t i = 0; i < takenCount; i++) cancel_alarm(taken[i]);
+    CHECK_EQ(simLineDecode(simUartTxLine(SIM_UART_KB), &decoder, KB_BAUD_RATE, simNowNs(), out, 16), 0);
+
+    macroPlay(0);
+    at(4000);
+    CHECK_EQ(simLineDecode(simUartTxLine(SIM_UART_KB), &decoder, KB_BAUD_RATE, simNowNs(), out, 16), 8);
+
+    return CHECK_RESULT();
+}
@@ -0,0 +1,81 @@
+// Mouse scaling and accumulation, including full scale 16 bit deltas with
+// acceleration, which come out past 16 bits.
+
+#include "sim.h"
+#include "check.h"
+#include "PicoX68Key.h"
+#include "x68k_port.h"
+#include "mouse.h"
+
+int firmwareMain(void);
+
+// Poll the way the X68000 does and return the packet.
+static void poll(uint8_t packet[3]) {
+    static simDecoder_t decoder;
+
+    simUartSend(SIM_UART_KB, simNowNs(), 0x41, KB_BAUD_RATE, 1);
+    simUartSend(SIM_UART_KB, simNowNs(), 0x40, KB_BAUD_RATE, 1);
+    simRunFor(20 * SIM_NS_PER_MS);
+
+    simByte_t b[3];
+    CHECK_EQ(simLineDecode(simUartTxLine(SIM_UART_MOUSE), &decoder, MOUSE_BAUD_RATE, simNowNs(), b, 3), 3);
+    for(uint8_t i = 0; i < 3; i++) packet[i] = b[i].byte;
+}
+
+static void testScale(void) {
+    mouseMotion_t m = { 0, 0 };
+    int32_t x, y;
+
+    mouseSetCurve(MOUSE_CURVE_LINEAR);
+    mouseScale(&m, 9, -9, &x, &y);
+    CHECK_EQ(x, 3);
+    CHECK_EQ(y, -3);
+
+    // The remainder carries: a third of a count at a time still gets there,
+    // give or take the fraction lost to rounding the table.
+    for(uint8_t i = 0; i < 3; i++) {
+        mouseScale(&m, 1, 0, &x, &y);
+        CHECK_EQ(x, 0);
+    }
+    mouseScale(&m, 1, 0, &x, &y);
+    CHECK_EQ(x, 1);
+
+    // Top gain is 4x over the divider of 3, so this is ~43690 counts.
+    mouseSetCurve(MOUSE_CURVE_STRONG);
+    m = (mouseMotion_t){ 0, 0 };
+    mouseScale(&m, 32767, -32768, &x, &y);
+    CHECK(x > 32767);
+    CHECK(y < -32768);
+    CHECK_EQ(x, 43686);
+    CHECK_EQ(y, -43688);
+}
+
+static void testAccumulate(void) {
+    uint8_t packet[3];
+
+    simBoot(firmwareMain);
+    mouseSetCurve(MOUSE_CURVE_STRONG);
+
+    // Used to wrap to the opposite direction on the way into the accumulator.
+    handleMouse(MOUSE_X68_LEFT, 32767, -32768, 0);
+    poll(packet);
+    CHECK_EQ(packet[0], MOUSE_X68_LEFT);
+    CHECK_EQ((int8_t)packet[1], 127);
+    CHECK_EQ((int8_t)packet[2], -128);
+
+    // The backlog is capped at 512 and drains in the right direction.
+    for(uint8_t i = 0; i < 3; i++) {
+        poll(packet);
+        CHECK_EQ((int8_t)packet[1], 127);
+        CHECK_EQ((int8_t)packet[2], -128);
+    }
+    poll(packet);
+    CHECK_EQ((int8_t)packet[1], 512 - 4 * 127);
+    CHECK_EQ((int8_t)packet[2], 0);
+}
+
+int main(void) {
+    testScale();
+    testAccumulate();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,146 @@
+// Serial remote framing: noise before a sync, batches split across USB
+// packets, and frames that must be thrown away whole.
+
+#include <string.h>
+#include "sim.h"
+#include "check.h"
+#include "x68k_port.h"
+#include "remote.h"
+#include "stats.h"
+
+#define SCAN_A 0x1E
+#define SCAN_B 0x2E
+#define SCAN_C 0x2C
+
+int firmwareMain(void);
+
+static simDecoder_t kbDecoder;
+
+// Scan codes sent since last time, up to max.
+static size_t kbOut(uint8_t *out, size_t max) {
+    simByte_t b[16];
+    const size_t n = simLineDecode(simUartTxLine(SIM_UART_KB), &kbDecoder, KB_BAUD_RATE, simNowNs(), b, 16);
+    for(size_t i = 0; i < n && i < max; i++) out[i] = b[i].byte;
+    return n;
+}
+
+// A frame around the payload, sum included.
+static size_t frame(uint8_t *out, const uint8_t *payload, uint8_t len) {
+    uint8_t sum = 0;
+    out[0] = REMOTE_SYNC1;
+    out[1] = REMOTE_SYNC_IN;
+    out[2] = len;
+    for(uint8_t i = 0; i < len; i++) sum += out[3 + i] = payload[i];
+    out[3 + len] = sum;
+    return 4 + len;
+}
+
+static void settle(void) {
+    simRunFor(50 * SIM_NS_PER_MS);
+}
+
+int main(void) {
+    uint8_t f[64], out[16];
+    size_t n;
+
+    simBoot(firmwareMain);
+    simCdcMount(0);
+    settle();
+    kbOut(out, sizeof(out));
+
+    // Noise, a false start and a doubled sync byte, then a good batch.
+    static const uint8_t tap[] = { REMOTE_EVT_KEY, 0x04, 1, REMOTE_EVT_KEY, 0x04, 0 };
+    static const uint8_t noise[] = { 0x00, 0xFF, 'X', 'Q', 'R', 0x03, 'X', 'X' };
+    simCdcSend(noise, sizeof(noise));
+    n = frame(f, tap, sizeof(tap));
+    simCdcSend(&f[1], n - 1);
+    settle();
+
+    n = kbOut(out, sizeof(out));
+    CHECK_EQ(n, 2);
+    CHECK_EQ(out[0], SCAN_A);
+    CHECK_EQ(out[1], SCAN_A | 0x80);
+    CHECK_EQ(statEvents[STAT_EVT_REMOTE_FRAMES], 1);
+    CHECK_EQ(statEvents[STAT_EVT_REMOTE_EVENTS], 2);
+
+    // Split inside the header, the payload and before the sum. Nothing
+    // happens until the sum is in.
+    static const uint8_t tapB[] = { REMOTE_EVT_KEY, 0x05, 1, REMOTE_EVT_KEY, 0x05, 0 };
+    n = frame(f, tapB, sizeof(tapB));
+    simCdcSend(&f[0], 2);
+    settle();
+    simCdcSend(&f[2], 3);
+    settle();
+    simCdcSend(&f[5], n - 6);
+    settle();
+    CHECK_EQ(kbOut(out, sizeof(out)), 0);
+    simCdcSend(&f[n - 1], 1);
+    settle();
+
+    n = kbOut(out, sizeof(out));
+    CHECK_EQ(n, 2);
+    CHECK_EQ(out[0], SCAN_B);
+    CHECK_EQ(out[1], SCAN_B | 0x80);
+
+    // A bad sum throws the batch away.
+    static const uint8_t tapC[] = { REMOTE_EVT_KEY, 0x06, 1, REMOTE_EVT_KEY, 0x06, 0 };
+    n = frame(f, tapC, sizeof(tapC));
+    f[n - 1] ^= 0x01;
+    simCdcSend(f, n);
+    settle();
+    CHECK_EQ(kbOut(out, sizeof(out)), 0);
+    CHECK_EQ(statEvents[STAT_EVT_REMOTE_BAD], 1);
+
+    // So does an event nobody knows, with the good ones before it.
+    static const uint8_t unknown[] = { REMOTE_EVT_KEY, 0x06, 1, 0x7E, REMOTE_EVT_KEY, 0x06, 0 };
+    n = frame(f, unknown, sizeof(unknown));
+    simCdcSend(f, n);
+    settle();
+    CHECK_EQ(kbOut(out, sizeof(out)), 0);
+    CHECK_EQ(statEvents[STAT_EVT_REMOTE_BAD], 2);
+
+    // And one cut short in the middle of an event.
+    static const uint8_t shortKey[] = { REMOTE_EVT_KEY, 0x06 };
+    n = frame(f, shortKey, sizeof(shortKey));
+    simCdcSend(f, n);
+    settle();
+    CHECK_EQ(kbOut(out, sizeof(out)), 0);
+    CHECK_EQ(statEvents[STAT_EVT_REMOTE_BAD], 3);
+    CHECK_EQ(statEvents[STAT_EVT_REMOTE_FRAMES], 2);
+    CHECK_EQ(statEvents[STAT_EVT_REMOTE_EVENTS], 4);
+
+    // Still in step afterwards, and telemetry comes back when asked for.
+    const uint8_t *rx;
+    const size_t rxBefore = simCdcReceived(&rx);
+    static const uint8_t tapCTelemetry[] = { REMOTE_EVT_KEY, 0x06, 1, REMOTE_EVT_KEY, 0x06, 0, REMOTE_EVT_TELEMETRY };
+    n = frame(f, tapCTelemetry, sizeof(tapCTelemetry));
+    simCdcSend(f, n);
+    settle();
+
+    n = kbOut(out, sizeof(out));
+    CHECK_EQ(n, 2);
+    CHECK_EQ(out[0], SCAN_C);
+    CHECK_EQ(out[1], SCAN_C | 0x80);
+
+    const size_t rxLen = simCdcReceived(&rx);
+    CHECK(rxLen > rxBefore + 3);
+    if(rxLen > rxBefore + 3) {
+        const uint8_t *t = &rx[rxBefore];
+        CHECK_EQ(t[0], REMOTE_SYNC1);
+        CHECK_EQ(t[1], REMOTE_SYNC_OUT);
+        CHECK_EQ(rxLen - rxBefore, 4 + t[2]);
+
+        uint8_t sum = 0;
+        for(uint8_t i = 0; i < t[2]; i++) sum += t[3 + i];
+        CHECK_EQ(t[3 + t[2]], sum);
+        CHECK_EQ(t[4], STAT_EVENTS + 2);
+
+        // Counters as of the batch that asked.
+        const uint8_t *frames = &t[5 + STAT_EVT_REMOTE_FRAMES * 4];
+        const uint8_t *bad = &t[5 + STAT_EVT_REMOTE_BAD * 4];
+        CHECK_EQ(frames[0], 3);
+        CHECK_EQ(bad[0], 3);
+    }
+
+    return CHECK_RESULT();
+}
@@ -0,0 +1,50 @@
+// The stats dump with every key chattering: the list stops at the cap and
+// says so, and the lines before it all make it out.
+
+#include "sim.h"
+#include "check.h"
+#include "stats.h"
+#include "keystate.h"
+#include "x68k_port.h"
+
+#define SCAN_RETURN 0x1D
+#define SCAN_PERIOD 0x32
+
+int firmwareMain(void);
+
+int main(void) {
+    static simByte_t out[8192];
+
+    simBoot(firmwareMain);
+
+    for(uint16_t u = 0; u < 256; u++) keyChatter[u] = UINT16_MAX;
+    statsDump();
+    simRunFor(30000 * SIM_NS_PER_MS);
+
+    simDecoder_t decoder = { 0 };
+    const size_t n = simLineDecode(simUartTxLine(SIM_UART_KB), &decoder, KB_BAUD_RATE, simNowNs(), out, 8192);
+
+    // Every key tapped, make then break.
+    uint16_t made = 0, returns = 0;
+    for(size_t i = 0; i < n; i++) {
+        if(out[i].byte & 0x80) continue;
+        made++;
+        if(out[i].byte == SCAN_RETURN) returns++;
+        CHECK(i + 1 < n && out[i + 1].byte == (out[i].byte | 0x80));
+    }
+
+    // A line per stage, the counters and the chatter.
+    CHECK_EQ(returns, STAT_STAGES + 2);
+
+    // Sixteen keys of chatter, each "<usage> ffff ", then "..." and RETURN.
+    CHECK(n >= 8);
+    if(n >= 8) {
+        static const uint8_t tail[] = {
+            SCAN_PERIOD, SCAN_PERIOD | 0x80, SCAN_PERIOD, SCAN_PERIOD | 0x80,
+            SCAN_PERIOD, SCAN_PERIOD | 0x80, SCAN_RETURN, SCAN_RETURN | 0x80
+        };
+        for(uint8_t i = 0; i < 8; i++) CHECK_EQ(out[n - 8 + i].byte, tail[i]);
+    }
+
+    return CHECK_RESULT();
+}
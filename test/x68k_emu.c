@@ -0,0 +1,521 @@
+// X68000 emulator: the host side of the keyboard and mouse port, for stress
+// testing the firmware end to end.
+//
+// The firmware runs in the simulator with a USB NKRO keyboard and a boot
+// mouse plugged in. This plays the X68000 and the user at once:
+// - rollover storms on the keyboard, one key per 1ms report, then released
+// - mouse motion at the USB report rate
+// - MSCTRL polls (0x41 then 0x40) and LED commands at their own rates, plus
+//   key data hold and resume (0x48/0x49) if asked for, all sent over the
+//   2400 baud 8N1 line to the keyboard's RX
+//
+// Everything the firmware sends back is decoded bit by bit off its TX pins:
+// 2400 baud 8N1 scan codes and 4800 baud 8N2 mouse packets. Then checked:
+// - every make and break arrives, in the order the keys changed, with
+//   typematic repeats of held keys as the only extras
+// - nothing goes out while key data is held
+// - one 3 byte mouse packet per poll, 2 stop bits, no overflow flags, and
+//   the motion adds up to exactly what the mouse sent
+// and reported: key latency from USB report to start bit, sustained scan
+// codes per second, and poll to packet latency and jitter.
+//
+//     x68k_emu [--seconds N] [--poll-hz N] [--led-hz N] [--mouse-hz N]
+//              [--storm-keys N] [--storm-every-ms N] [--hold-ms N]
+//              [--hold-every-ms N] [--max-latency-ms N]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sim.h"
+#include "tusb.h"
+#include "x68k_port.h"
+#include "layout.h"
+
+#define KB_ADDR    1
+#define MOUSE_ADDR 2
+
+#define KB_BIT_NS    (1000000000ull / KB_BAUD_RATE)
+#define MOUSE_BIT_NS (1000000000ull / MOUSE_BAUD_RATE)
+
+// Bytes the firmware can already have in the UART when it's told to hold:
+// the holding register and the shift register.
+#define HOLD_GRACE_NS (2 * 10 * KB_BIT_NS)
+
+#define MAX_STORM_KEYS 64
+#define HOLD_LENGTH_MS 100
+#define DRAIN_MAX_MS 10000
+
+int firmwareMain(void);
+
+typedef struct {
+    double seconds;
+    uint32_t pollHz;
+    uint32_t ledHz;
+    uint32_t mouseHz;
+    uint32_t stormKeys;
+    uint32_t stormEveryMs;
+    uint32_t holdMs;
+    uint32_t holdEveryMs;
+    double maxLatencyMs;
+} options_t;
+
+static options_t opt = { 5, 60, 2, 1000, 10, 250, 40, 0, 0 };
+
+// NKRO keyboard: modifiers, then one bit for each usage 0x00-0x67. LEDs out.
+static const uint8_t nkroDescriptor[] = {
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01,
+    0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+    0x05, 0x07, 0x19, 0x00, 0x29, 0x67, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x68, 0x81, 0x02,
+    0x05, 0x08, 0x19, 0x01, 0x29, 0x05, 0x95, 0x05, 0x75, 0x01, 0x91, 0x02,
+    0x95, 0x01, 0x75, 0x03, 0x91, 0x01,
+    0xC0
+};
+
+#define NKRO_REPORT_LEN (1 + 0x68 / 8)
+
+static uint32_t seed = 1;
+
+static uint32_t rnd(uint32_t n) {
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) % n;
+}
+
+//--------------------------------------------------------------------+
+// What was sent, to check against
+//--------------------------------------------------------------------+
+
+typedef struct {
+    uint8_t code;
+    uint64_t atNs;
+} sent_t;
+
+typedef struct {
+    uint64_t fromNs, toNs;
+} window_t;
+
+static sent_t *keysSent = NULL;
+static size_t keysSentCount = 0, keysSentCap = 0;
+
+static uint64_t *polls = NULL;      // When each 0x40 was received
+static size_t pollCount = 0, pollCap = 0;
+
+static window_t holds[1024];
+static size_t holdCount = 0;
+
+static int64_t motionX = 0, motionY = 0;   // In X68000 counts
+static uint32_t ledCommands = 0;
+
+static void *grow(void *p, size_t *cap, size_t count, size_t size) {
+    if(count < *cap) return p;
+    *cap = *cap ? *cap * 2 : 1024;
+    p = realloc(p, *cap * size);
+    if(!p) simFail("out of memory");
+    return p;
+}
+
+// From the X68000 to the keyboard. Returns when the UART has it: half way
+// through the stop bit, which is where it samples it.
+static uint64_t command(uint8_t cmd) {
+    return simUartSend(SIM_UART_KB, simNowNs(), cmd, KB_BAUD_RATE, 1) + 19 * KB_BIT_NS / 2;
+}
+
+//--------------------------------------------------------------------+
+// The user
+//--------------------------------------------------------------------+
+
+static uint8_t keyPool[256];
+static uint16_t keyPoolCount = 0;
+
+// Keys that send one scan code on the normal layer, and nothing clever.
+static void buildKeyPool(void) {
+    for(uint16_t u = 0x04; u < 0x68; u++) {
+        if(!layoutLookup(LAYOUT_LAYER_NORMAL, u) || layoutAction(u) || layoutCombo(u)) continue;
+        keyPool[keyPoolCount++] = u;
+    }
+    if(opt.stormKeys > keyPoolCount || opt.stormKeys > MAX_STORM_KEYS) simFail("too many storm keys");
+}
+
+static uint8_t report[NKRO_REPORT_LEN];
+
+static void keyChange(uint8_t usage, bool down) {
+    const uint8_t bit = 1 << (usage & 7);
+    if(down) report[1 + usage / 8] |= bit; else report[1 + usage / 8] &= ~bit;
+    simHidReport(KB_ADDR, 0, report, sizeof(report));
+
+    const uint8_t code = layoutLookup(LAYOUT_LAYER_NORMAL, usage) | (down ? 0 : 0x80);
+    keysSent = grow(keysSent, &keysSentCap, keysSentCount, sizeof(sent_t));
+    keysSent[keysSentCount++] = (sent_t){ code, simNowNs() };
+}
+
+typedef enum {
+    STORM_IDLE,
+    STORM_PRESSING,
+    STORM_HOLDING,
+    STORM_RELEASING
+} stormPhase_t;
+
+static struct {
+    stormPhase_t phase;
+    uint8_t keys[MAX_STORM_KEYS];
+    uint8_t done;
+    uint64_t startNs;
+    uint64_t nextNs;
+} storm;
+
+// One step of the storm, due at storm.nextNs.
+static void stormStep(void) {
+    switch(storm.phase) {
+        case STORM_IDLE:
+            // Distinct keys, in a random order.
+            for(uint8_t i = 0; i < opt.stormKeys; i++) {
+                uint8_t usage;
+                do usage = keyPool[rnd(keyPoolCount)]; while(memchr(storm.keys, usage, i));
+                storm.keys[i] = usage;
+            }
+            storm.startNs = simNowNs();
+            storm.done = 0;
+            storm.phase = STORM_PRESSING;
+            // Fall through to the first press.
+
+        case STORM_PRESSING:
+            keyChange(storm.keys[storm.done++], true);
+            if(storm.done == opt.stormKeys) {
+                storm.phase = STORM_HOLDING;
+                storm.nextNs = simNowNs() + opt.holdMs * SIM_NS_PER_MS;
+            }else{
+                storm.nextNs = simNowNs() + SIM_NS_PER_MS;
+            }
+        break;
+
+        case STORM_HOLDING:
+            storm.phase = STORM_RELEASING;
+            storm.done = 0;
+            // Fall through to the first release.
+
+        case STORM_RELEASING:
+            keyChange(storm.keys[storm.done++], false);
+            storm.nextNs = simNowNs() + SIM_NS_PER_MS;
+            if(storm.done == opt.stormKeys) {
+                storm.phase = STORM_IDLE;
+                const uint64_t nextStorm = storm.startNs + opt.stormEveryMs * SIM_NS_PER_MS;
+                if(nextStorm > storm.nextNs) storm.nextNs = nextStorm;
+            }
+        break;
+    }
+}
+
+// Multiples of 3 so the linear curve's divider leaves no remainder.
+static void mouseStep(void) {
+    const int8_t dx = 3 * ((int8_t)rnd(7) - 3);
+    const int8_t dy = 3 * ((int8_t)rnd(7) - 3);
+    const uint8_t r[3] = { 0, (uint8_t)dx, (uint8_t)dy };
+
+    simHidReport(MOUSE_ADDR, 0, r, sizeof(r));
+    motionX += dx / 3;
+    motionY += dy / 3;
+}
+
+//--------------------------------------------------------------------+
+// The X68000
+//--------------------------------------------------------------------+
+
+static void poll(void) {
+    command(0x41);
+    polls = grow(polls, &pollCap, pollCount, sizeof(uint64_t));
+    polls[pollCount++] = command(0x40);
+}
+
+static void ledStep(void) {
+    static uint8_t state = 0;
+    state = (state + 1) & 0x7F;
+    command(0x80 | state);
+    ledCommands++;
+}
+
+static bool held = false;
+
+static void holdStep(void) {
+    if(!held) {
+        if(holdCount == sizeof(holds) / sizeof(holds[0])) simFail("too many holds");
+        holds[holdCount].fromNs = command(0x48) + HOLD_GRACE_NS;
+    }else{
+        holds[holdCount++].toNs = command(0x49);
+    }
+    held = !held;
+}
+
+//--------------------------------------------------------------------+
+// Checking
+//--------------------------------------------------------------------+
+
+static int compareU64(const void *a, const void *b) {
+    const uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double ms(uint64_t ns) {
+    return ns / 1e6;
+}
+
+static size_t decodeAll(uint8_t uart, uint32_t baud, simByte_t **out) {
+    size_t cap = 4096, count = 0;
+    simDecoder_t decoder = { 0 };
+
+    *out = malloc(cap * sizeof(simByte_t));
+    for(;;) {
+        const size_t n = simLineDecode(simUartTxLine(uart), &decoder, baud, simNowNs(), *out + count, cap - count);
+        count += n;
+        if(count < cap) return count;
+        cap *= 2;
+        *out = realloc(*out, cap * sizeof(simByte_t));
+    }
+}
+
+static bool inHold(uint64_t ns) {
+    for(size_t i = 0; i < holdCount; i++) {
+        if(ns >= holds[i].fromNs && ns < holds[i].toNs) return true;
+    }
+    return false;
+}
+
+static int checkKeys(void) {
+    simByte_t *codes;
+    const size_t n = decodeAll(SIM_UART_KB, KB_BAUD_RATE, &codes);
+
+    uint64_t *latency = malloc((keysSentCount + 1) * sizeof(uint64_t));
+    bool down[128] = { false };
+    size_t next = 0;
+    uint32_t repeats = 0, violations = 0, framing = 0, duringHold = 0;
+
+    for(size_t i = 0; i < n; i++) {
+        const simByte_t *b = &codes[i];
+        if(b->framingError) framing++;
+        if(inHold(b->startNs)) duringHold++;
+
+        if(next < keysSentCount && b->byte == keysSent[next].code) {
+            latency[next] = b->startNs - keysSent[next].atNs;
+            next++;
+        }else if(!(b->byte & 0x80) && down[b->byte]) {
+            repeats++;
+        }else{
+            if(violations < 10) {
+                printf("  out of order: %02x at %.3f ms, expected %02x\n", b->byte, ms(b->startNs),
+                       next < keysSentCount ? keysSent[next].code : 0);
+            }
+            violations++;
+        }
+        down[b->byte & 0x7F] = !(b->byte & 0x80);
+    }
+
+    const size_t lost = keysSentCount - next;
+    qsort(latency, next, sizeof(uint64_t), compareU64);
+    uint64_t sum = 0;
+    for(size_t i = 0; i < next; i++) sum += latency[i];
+
+    const double spanS = n > 1 ? (codes[n - 1].startNs - codes[0].startNs) / 1e9 : 0;
+    const double rate = spanS > 0 ? (n - 1) / spanS : 0;
+
+    // The busiest second is what the link sustains when there's a backlog.
+    size_t busiest = 0;
+    for(size_t i = 0, j = 0; i < n; i++) {
+        while(codes[i].startNs - codes[j].startNs >= 1000000000ull) j++;
+        if(i - j + 1 > busiest) busiest = i - j + 1;
+    }
+
+    printf("keyboard: %zu key changes, %zu scan codes, %u typematic repeats\n", keysSentCount, n, repeats);
+    if(next) {
+        printf("  latency: mean %.2f ms, p50 %.2f ms, p99 %.2f ms, max %.2f ms\n", ms(sum / next),
+               ms(latency[next / 2]), ms(latency[next * 99 / 100]), ms(latency[next - 1]));
+    }
+    printf("  %.1f scan codes/s on average, %zu in the busiest second, %.0f%% of the link\n", rate, busiest,
+           busiest * 10 * 100.0 / KB_BAUD_RATE);
+    printf("  ordering violations %u, lost %zu, framing errors %u, sent while held %u\n", violations, lost, framing, duringHold);
+
+    int failed = violations || lost || framing || duringHold;
+    if(opt.maxLatencyMs && next && ms(latency[next - 1]) > opt.maxLatencyMs) {
+        printf("  max latency over %.1f ms\n", opt.maxLatencyMs);
+        failed = 1;
+    }
+
+    free(latency);
+    free(codes);
+    return failed;
+}
+
+static int checkMouse(void) {
+    simByte_t *bytes;
+    const size_t n = decodeAll(SIM_UART_MOUSE, MOUSE_BAUD_RATE, &bytes);
+
+    uint32_t bad = 0, framing = 0;
+    int64_t x = 0, y = 0;
+    uint64_t *delay = malloc((pollCount + 1) * sizeof(uint64_t));
+    size_t packets = 0;
+
+    for(size_t i = 0; i + 2 < n; i += 3) {
+        const simByte_t *p = &bytes[i];
+
+        // 8N2: each byte starts at least 11 bits after the one before.
+        for(uint8_t j = 0; j < 3; j++) if(p[j].framingError) framing++;
+        if(p[1].startNs - p[0].startNs < 11 * MOUSE_BIT_NS || p[2].startNs - p[1].startNs < 11 * MOUSE_BIT_NS) bad++;
+        if(p[2].startNs - p[0].startNs > 3 * 11 * MOUSE_BIT_NS) bad++;
+        if(p[0].byte & 0xFC) bad++;
+
+        x += (int8_t)p[1].byte;
+        y += (int8_t)p[2].byte;
+
+        if(packets < pollCount) delay[packets] = p[0].startNs - polls[packets];
+        packets++;
+    }
+    if(n % 3) bad++;
+
+    uint64_t sum = 0, minNs = UINT64_MAX, maxNs = 0;
+    const size_t timed = packets < pollCount ? packets : pollCount;
+    for(size_t i = 0; i < timed; i++) {
+        sum += delay[i];
+        if(delay[i] < minNs) minNs = delay[i];
+        if(delay[i] > maxNs) maxNs = delay[i];
+    }
+    double var = 0;
+    for(size_t i = 0; i < timed; i++) var += pow(delay[i] - (double)sum / timed, 2);
+
+    printf("mouse: %zu polls, %zu packets, motion %lld,%lld sent %lld,%lld\n", pollCount, packets,
+           (long long)x, (long long)y, (long long)motionX, (long long)motionY);
+    if(timed) {
+        printf("  poll to packet: mean %.1f us, min %.1f us, max %.1f us, jitter %.1f us (sd %.1f us)\n",
+               sum / timed / 1e3, minNs / 1e3, maxNs / 1e3, (maxNs - minNs) / 1e3, sqrt(var / timed) / 1e3);
+    }
+    printf("  bad packets %u, framing errors %u\n", bad, framing);
+
+    free(delay);
+    free(bytes);
+    return bad || framing || packets != pollCount || x != motionX || y != motionY;
+}
+
+static int checkLeds(void) {
+    const simCtrl_t *log;
+    const size_t n = simCtrlLog(&log);
+    uint32_t reports = 0;
+
+    for(size_t i = 0; i < n; i++) {
+        if(log[i].kind == SIM_CTRL_SET_REPORT && log[i].addr == KB_ADDR) reports++;
+    }
+
+    printf("leds: %u commands, %u output reports\n", ledCommands, reports);
+    return ledCommands && !reports;
+}
+
+//--------------------------------------------------------------------+
+// Run
+//--------------------------------------------------------------------+
+
+static void parseArgs(int argc, char **argv) {
+    for(int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        if(i + 1 == argc) simFail("%s needs a value", a);
+        const double v = atof(argv[++i]);
+
+        if(!strcmp(a, "--seconds")) opt.seconds = v;
+        else if(!strcmp(a, "--poll-hz")) opt.pollHz = v;
+        else if(!strcmp(a, "--led-hz")) opt.ledHz = v;
+        else if(!strcmp(a, "--mouse-hz")) opt.mouseHz = v;
+        else if(!strcmp(a, "--storm-keys")) opt.stormKeys = v;
+        else if(!strcmp(a, "--storm-every-ms")) opt.stormEveryMs = v;
+        else if(!strcmp(a, "--hold-ms")) opt.holdMs = v;
+        else if(!strcmp(a, "--hold-every-ms")) opt.holdEveryMs = v;
+        else if(!strcmp(a, "--max-latency-ms")) opt.maxLatencyMs = v;
+        else simFail("unknown option %s", a);
+    }
+}
+
+static uint64_t every(uint32_t hz) {
+    return hz ? 1000000000ull / hz : UINT64_MAX;
+}
+
+static void consider(uint64_t *next, uint64_t t) {
+    if(t < *next) *next = t;
+}
+
+int main(int argc, char **argv) {
+    parseArgs(argc, argv);
+
+    simBoot(firmwareMain);
+    buildKeyPool();
+
+    simHidMount(KB_ADDR, 0, HID_ITF_PROTOCOL_KEYBOARD, nkroDescriptor, sizeof(nkroDescriptor));
+    simHidMount(MOUSE_ADDR, 0, HID_ITF_PROTOCOL_MOUSE, NULL, 0);
+    simRunFor(50 * SIM_NS_PER_MS);
+
+    // What an X68000 sends at boot, more or less: LEDs, brightness, repeat.
+    command(0xFF);
+    command(0x54);
+    command(0x63);
+    command(0x74);
+    simRunFor(50 * SIM_NS_PER_MS);
+
+    const uint64_t startNs = simNowNs();
+    const uint64_t endNs = startNs + (uint64_t)(opt.seconds * 1e9);
+
+    uint64_t nextPoll = startNs, nextLed = startNs + every(opt.ledHz) / 2, nextMouse = startNs;
+    uint64_t nextHold = opt.holdEveryMs ? startNs + opt.holdEveryMs * SIM_NS_PER_MS : UINT64_MAX;
+    storm.nextNs = opt.stormKeys ? startNs : UINT64_MAX;
+
+    for(;;) {
+        uint64_t t = UINT64_MAX;
+        consider(&t, nextPoll);
+        consider(&t, nextLed);
+        consider(&t, nextMouse);
+        consider(&t, nextHold);
+        consider(&t, storm.nextNs);
+
+        // Storms finish, so every key that went down comes up again.
+        if(t >= endNs && (storm.phase == STORM_IDLE || t != storm.nextNs)) break;
+        simRunUntil(t);
+
+        if(t == storm.nextNs) stormStep();
+        if(t == nextMouse && t < endNs) {
+            mouseStep();
+            nextMouse += every(opt.mouseHz);
+        }
+        if(t == nextPoll) {
+            poll();
+            nextPoll += every(opt.pollHz);
+        }
+        if(t == nextLed) {
+            ledStep();
+            nextLed += every(opt.ledHz);
+        }
+        if(t == nextHold) {
+            holdStep();
+            nextHold += (held ? HOLD_LENGTH_MS : opt.holdEveryMs - HOLD_LENGTH_MS) * SIM_NS_PER_MS;
+        }
+    }
+    if(held) holdStep();
+
+    // Drain the keyboard backlog, then poll until the mouse has nothing left.
+    // A key stuck down repeats forever, so give up after a while.
+    const simLine_t *kbLine = simUartTxLine(SIM_UART_KB);
+    const uint64_t drainEndNs = simNowNs() + DRAIN_MAX_MS * SIM_NS_PER_MS;
+    size_t edges;
+    do {
+        edges = kbLine->count;
+        simRunFor(200 * SIM_NS_PER_MS);
+    } while(kbLine->count != edges && simNowNs() < drainEndNs);
+
+    for(uint8_t i = 0; i < 8; i++) {
+        poll();
+        simRunFor(20 * SIM_NS_PER_MS);
+    }
+    simRunFor(50 * SIM_NS_PER_MS);
+
+    printf("%.1f s simulated, %u flash lockouts (%.1f ms), %u command overruns\n",
+           (simNowNs() - startNs) / 1e9, simFlashLockouts(), ms(simFlashLockoutNs()), simUartOverruns(SIM_UART_KB));
+
+    int failed = simUartOverruns(SIM_UART_KB) != 0;
+    failed |= checkKeys();
+    failed |= checkMouse();
+    failed |= checkLeds();
+
+    printf(failed ? "FAILED\n" : "ok\n");
+    return failed;
+}
@@ -0,0 +1,288 @@
+# Layout compiler: turns a layouts/*.layout text file into the const tables
+# layout.c builds in. Run at build time by picox68key_layouts():
+#
+#     cmake -DINPUT=layouts/us.layout -DOUTPUT=layout_us.h -P layoutc.cmake
+#
+# One statement per line. Numbers are hex without 0x, as in the traces, and #
+# starts a comment. Later lines replace earlier ones for the same key.
+#
+#     name <text>                       Shown when cycling layouts
+#     include <file>                    Start from another layout, relative to this one
+#     key <usage> <scan>                Normal layer
+#     special <usage> <scan>            While Left GUI is held
+#     fn <usage> <scan>                 Fn layer
+#     hold <usage> special|fn           Layer while held
+#     toggle <usage> special|fn         Layer on/off each press
+#     tapkey <usage> <tap> <scan>       Tap sends tap, held sends scan
+#     taplayer <usage> <tap> special|fn Tap sends tap, held holds the layer
+#     combo <usage> <usage> <scan>      Both together send scan instead
+#     none <usage>                      Forget whatever the key was given
+#
+# The C names come from the file name, so us.layout gives layout_us.
+
+cmake_minimum_required(VERSION 3.13)
+
+if(NOT INPUT OR NOT OUTPUT)
+    message(FATAL_ERROR "usage: cmake -DINPUT=<file.layout> -DOUTPUT=<header> -P layoutc.cmake")
+endif()
+
+set(hexDigits 0 1 2 3 4 5 6 7 8 9 A B C D E F)
+
+# Every line of file, and of the files it includes, as "file:line:text".
+function(readLayout file depth out)
+    if(depth GREATER 8)
+        message(FATAL_ERROR "${file}: includes nest too deep")
+    endif()
+    if(NOT EXISTS ${file})
+        message(FATAL_ERROR "${file}: no such layout")
+    endif()
+
+    # Comments go before the text becomes a list, as ; and [ in them would
+    # split or join lines. None of the three means anything outside one.
+    get_filename_component(dir ${file} DIRECTORY)
+    file(READ ${file} text)
+    string(REGEX REPLACE "#[^\n]*" "" text "${text}")
+    string(REGEX REPLACE "[][;]" "?" text "${text}")
+    string(REPLACE "\n" ";" lines "${text}")
+    set(result "")
+    set(lineNo 0)
+    foreach(line IN LISTS lines)
+        math(EXPR lineNo "${lineNo} + 1")
+        string(STRIP "${line}" line)
+        if(line STREQUAL "")
+            continue()
+        endif()
+
+        if(line MATCHES "^include[ \t]+(.+)$")
+            get_filename_component(inner ${CMAKE_MATCH_1} ABSOLUTE BASE_DIR ${dir})
+            math(EXPR innerDepth "${depth} + 1")
+            readLayout(${inner} ${innerDepth} innerLines)
+            list(APPEND result ${innerLines})
+        else()
+            list(APPEND result "${file}:${lineNo}:${line}")
+        endif()
+    endforeach()
+    set(${out} ${result} PARENT_SCOPE)
+endfunction()
+
+# Two hex digits, upper case, checked.
+macro(parseByte text var)
+    if(NOT "${text}" MATCHES "^[0-9A-Fa-f][0-9A-Fa-f]?$")
+        message(FATAL_ERROR "${where}: '${text}' isn't a hex byte")
+    endif()
+    string(TOUPPER "${text}" ${var})
+    string(LENGTH "${${var}}" len)
+    if(len EQUAL 1)
+        set(${var} "0${${var}}")
+    endif()
+endmacro()
+
+macro(parseLayer text var)
+    if("${text}" STREQUAL "special")
+        set(${var} LAYOUT_LAYER_SPECIAL)
+    elseif("${text}" STREQUAL "fn")
+        set(${var} LAYOUT_LAYER_FN)
+    else()
+        message(FATAL_ERROR "${where}: '${text}' isn't a layer, use special or fn")
+    endif()
+endmacro()
+
+# Usage as a decimal index, for the per-key variables.
+macro(usageIndex hex var)
+    math(EXPR ${var} "0x${hex}")
+endmacro()
+
+macro(forgetKey u)
+    unset(action_${u})
+    if(DEFINED combo_${u})
+        set(other ${combo_${u}})
+        unset(combo_${other})
+        unset(combo_${u})
+    endif()
+endmacro()
+
+get_filename_component(INPUT ${INPUT} ABSOLUTE)
+get_filename_component(id ${INPUT} NAME_WE)
+if(NOT id MATCHES "^[a-z][a-z0-9_]*$")
+    message(FATAL_ERROR "${INPUT}: file name must be lower case letters, digits and _")
+endif()
+
+set(name "")
+readLayout(${INPUT} 0 statements)
+
+foreach(statement IN LISTS statements)
+    string(REGEX MATCH "^(.*:[0-9]+):(.*)$" unused "${statement}")
+    set(where ${CMAKE_MATCH_1})
+    set(body "${CMAKE_MATCH_2}")
+    separate_arguments(args UNIX_COMMAND "${body}")
+    list(LENGTH args argc)
+    list(GET args 0 op)
+
+    if(op STREQUAL "name")
+        string(REGEX REPLACE "^name[ \t]+" "" name "${body}")
+        if(NOT name MATCHES "^[ -~]+$" OR name MATCHES "[\"\\\\]")
+            message(FATAL_ERROR "${where}: name must be printable ASCII without quotes or backslashes")
+        endif()
+    elseif(op MATCHES "^(key|special|fn)$" AND argc EQUAL 3)
+        list(GET args 1 a)
+        list(GET args 2 b)
+        parseByte(${a} usage)
+        parseByte(${b} scan)
+        usageIndex(${usage} u)
+        set(${op}_${u} ${scan})
+    elseif(op MATCHES "^(hold|toggle)$" AND argc EQUAL 3)
+        list(GET args 1 a)
+        list(GET args 2 b)
+        parseByte(${a} usage)
+        parseLayer(${b} layer)
+        usageIndex(${usage} u)
+        forgetKey(${u})
+        if(op STREQUAL "hold")
+            set(action_${u} "LAYOUT_ACTION_LAYER_HOLD, 0x00, ${layer}")
+        else()
+            set(action_${u} "LAYOUT_ACTION_LAYER_TOGGLE, 0x00, ${layer}")
+        endif()
+    elseif(op STREQUAL "tapkey" AND argc EQUAL 4)
+        list(GET args 1 a)
+        list(GET args 2 b)
+        list(GET args 3 c)
+        parseByte(${a} usage)
+        parseByte(${b} tap)
+        parseByte(${c} scan)
+        usageIndex(${usage} u)
+        forgetKey(${u})
+        set(action_${u} "LAYOUT_ACTION_TAP_KEY, 0x${tap}, 0x${scan}")
+    elseif(op STREQUAL "taplayer" AND argc EQUAL 4)
+        list(GET args 1 a)
+        list(GET args 2 b)
+        list(GET args 3 c)
+        parseByte(${a} usage)
+        parseByte(${b} tap)
+        parseLayer(${c} layer)
+        usageIndex(${usage} u)
+        forgetKey(${u})
+        set(action_${u} "LAYOUT_ACTION_TAP_LAYER, 0x${tap}, ${layer}")
+    elseif(op STREQUAL "combo" AND argc EQUAL 4)
+        list(GET args 1 a)
+        list(GET args 2 b)
+        list(GET args 3 c)
+        parseByte(${a} usage1)
+        parseByte(${b} usage2)
+        parseByte(${c} scan)
+        usageIndex(${usage1} u1)
+        usageIndex(${usage2} u2)
+        if(u1 EQUAL u2)
+            message(FATAL_ERROR "${where}: a combo needs two different keys")
+        endif()
+        forgetKey(${u1})
+        forgetKey(${u2})
+        # The layer engine looks a combo up from either key, so each key
+        # can only be in one, and not have an action as well.
+        set(combo_${u1} ${u2})
+        set(combo_${u2} ${u1})
+        set(comboScan_${u1} ${scan})
+        set(comboScan_${u2} ${scan})
+    elseif(op STREQUAL "none" AND argc EQUAL 2)
+        list(GET args 1 a)
+        parseByte(${a} usage)
+        usageIndex(${usage} u)
+        forgetKey(${u})
+        unset(key_${u})
+        unset(special_${u})
+        unset(fn_${u})
+    else()
+        message(FATAL_ERROR "${where}: don't understand '${body}'")
+    endif()
+endforeach()
+
+if(name STREQUAL "")
+    message(FATAL_ERROR "${INPUT}: no name")
+endif()
+
+# Everything gathered, in usage order.
+set(keymap "")
+set(special "")
+set(fn "")
+set(actions "")
+set(combos "")
+foreach(hi RANGE 15)
+    list(GET hexDigits ${hi} h)
+    set(row "")
+    foreach(lo RANGE 15)
+        list(GET hexDigits ${lo} l)
+        math(EXPR u "${hi} * 16 + ${lo}")
+
+        if(DEFINED key_${u})
+            set(code 0x${key_${u}})
+        else()
+            set(code 0x00)
+        endif()
+        if(lo EQUAL 0)
+            set(row "\t${code}")
+        else()
+            set(row "${row}, ${code}")
+        endif()
+
+        foreach(layer special fn)
+            if(DEFINED ${layer}_${u})
+                list(APPEND ${layer} "{0x${h}${l}, 0x${${layer}_${u}}}")
+            endif()
+        endforeach()
+        if(DEFINED action_${u})
+            list(APPEND actions "{0x${h}${l}, ${action_${u}}}")
+        endif()
+        if(DEFINED combo_${u} AND combo_${u} GREATER u)
+            set(other ${combo_${u}})
+            set(scan ${comboScan_${u}})
+            math(EXPR oh "${other} / 16")
+            math(EXPR ol "${other} % 16")
+            list(GET hexDigits ${oh} oh)
+            list(GET hexDigits ${ol} ol)
+            list(APPEND combos "{0x${h}${l}, 0x${oh}${ol}, 0x${scan}}")
+        endif()
+    endforeach()
+
+    if(hi EQUAL 15)
+        string(APPEND keymap "${row}};\t// ${h}x\n")
+    else()
+        string(APPEND keymap "${row},\t// ${h}x\n")
+    endif()
+endforeach()
+
+file(RELATIVE_PATH source ${CMAKE_CURRENT_LIST_DIR}/.. ${INPUT})
+string(TOUPPER ${id} ID)
+
+set(text "// Generated from ${source} by tools/layoutc.cmake. Edit that, not this.\n\n")
+string(APPEND text "#ifndef _LAYOUT_${ID}_H_INCLUDED\n#define _LAYOUT_${ID}_H_INCLUDED\n\n#include \"layout.h\"\n\n")
+string(APPEND text "static const uint8_t keymap_${id}[256] = {\n${keymap}\n")
+
+# Lists the layout has none of are NULL, 0 in layout_t.
+set(members "")
+foreach(list special fn actions combos)
+    if(list STREQUAL "actions")
+        set(type layoutAction_t)
+    elseif(list STREQUAL "combos")
+        set(type layoutCombo_t)
+    else()
+        set(type layoutKey_t)
+    endif()
+
+    if(${list})
+        string(REPLACE ";" ",\n\t" entries "${${list}}")
+        string(APPEND text "static const ${type} ${list}_${id}[] = {\n\t${entries}};\n\n")
+        string(APPEND members ",\n\t${list}_${id}, count_of(${list}_${id})")
+    else()
+        string(APPEND members ",\n\tNULL, 0")
+    endif()
+endforeach()
+
+string(APPEND text "static const layout_t layout_${id} = {\n\t\"${name}\",\n\tkeymap_${id}${members}\n};\n\n#endif\n")
+
+# Only touch the header if it changed, so layout.c doesn't rebuild for nothing.
+if(EXISTS ${OUTPUT})
+    file(READ ${OUTPUT} old)
+    if(old STREQUAL text)
+        return()
+    endif()
+endif()
+file(WRITE ${OUTPUT} "${text}")
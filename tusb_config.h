@@ -101,7 +101,7 @@
 //--------------------------------------------------------------------
 
 // Size of buffer to hold descriptors and other data used for enumeration
-#define CFG_TUH_ENUMERATION_BUFSIZE 256
+#define CFG_TUH_ENUMERATION_BUFSIZE 512
 
 #define CFG_TUH_HUB                 1 // number of supported hubs
 #define CFG_TUH_CDC                 1 // CDC ACM
@@ -129,6 +129,10 @@
 // bit rate = 115200, 1 stop bit, no parity, 8 bit data width
 #define CFG_TUH_CDC_LINE_CODING_ON_ENUM   { 115200, CDC_LINE_CODING_STOP_BITS_1, CDC_LINE_CODING_PARITY_NONE, 8 }
 
+// Room for a whole telemetry frame (remote.c), and a few batches coming in
+#define CFG_TUH_CDC_TX_BUFSIZE            256
+#define CFG_TUH_CDC_RX_BUFSIZE            256
+
 
 #ifdef __cplusplus
  }
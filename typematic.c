@@ -0,0 +1,60 @@
+// Key repeat, as the X68000 keyboard does it.
+//
+// The real keyboard repeats the make code of the last key pressed for as long
+// as it's held. The host programs the timing:
+//   0x6n  delay before the first repeat, 200 + n * 100 ms
+//   0x7n  interval between repeats, 30 + n * n * 5 ms
+// Repeats are paced by an alarm that reschedules relative to its own target
+// time, so the interval doesn't drift with interrupt latency.
+
+#include "pico/stdlib.h"
+#include "typematic.h"
+#include "x68k_port.h"
+
+#define X68_MOD_FIRST  0x70     // SHIFT, CTRL, OPT.1, OPT.2
+#define X68_MOD_LAST   0x73
+#define X68_LOCK_FIRST 0x5A     // KANA through FULLWIDTH toggle, so don't repeat
+#define X68_LOCK_LAST  0x60
+
+static volatile uint8_t repeatKey = 0;
+static alarm_id_t repeatAlarm = 0;
+
+static uint32_t delayUs(void) {
+    return (200 + (x68kRepeatDelay & 0x0F) * 100) * 1000;
+}
+
+static uint32_t intervalUs(void) {
+    const uint32_t n = x68kRepeatInterval & 0x0F;
+    return (30 + n * n * 5) * 1000;
+}
+
+static int64_t repeatFire(alarm_id_t id, void *userData) {
+    if(!repeatKey) {
+        repeatAlarm = 0;
+        return 0;
+    }
+
+    // No point queueing repeats behind the host's back while key data is held.
+    if(keyDataEnabled) kbSend(repeatKey);
+    return intervalUs();
+}
+
+static void stop(void) {
+    repeatKey = 0;
+    if(repeatAlarm > 0) cancel_alarm(repeatAlarm);
+    repeatAlarm = 0;
+}
+
+void typematicPress(uint8_t code) {
+    if(code >= X68_MOD_FIRST && code <= X68_MOD_LAST) return;
+    if(code >= X68_LOCK_FIRST && code <= X68_LOCK_LAST) return;
+
+    // Only the most recent key repeats.
+    stop();
+    repeatKey = code;
+    repeatAlarm = add_alarm_in_us(delayUs(), repeatFire, NULL, true);
+}
+
+void typematicRelease(uint8_t code) {
+    if(code == repeatKey) stop();
+}
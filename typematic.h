@@ -0,0 +1,13 @@
+// Key repeat, as the X68000 keyboard does it.
+
+#ifndef _TYPEMATIC_H_INCLUDED
+#define _TYPEMATIC_H_INCLUDED
+
+#include <stdint.h>
+
+// Called with X68000 scan codes as they go out. Release must be reported
+// before the break code is sent, so a repeat can't sneak in after it.
+void typematicPress(uint8_t code);
+void typematicRelease(uint8_t code);
+
+#endif
@@ -0,0 +1,374 @@
+// Types a text file from a USB stick into the X68000.
+//
+// For getting BASIC listings and config files across without retyping them.
+// Left GUI + T types the first .TXT file in the root directory of the stick;
+// any key pressed on the keyboard stops it.
+//
+// The file is read one 512 byte sector at a time straight off the block
+// device with a bare FAT16/FAT32 reader: MBR or not, root directory, then
+// the cluster chain, reusing the same sector buffer for the FAT lookups. No
+// more than a sector of the file is ever in RAM.
+//
+// Characters go out through the macro engine, which already runs the link
+// flat out while leaving room for live keys, and waits while the X68000 has
+// key data stopped. Only a few dozen steps are queued at a time so an abort
+// takes effect almost straight away. SHIFT stays down across runs of shifted
+// characters rather than going up and down around each one.
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "tusb.h"
+#include "typer.h"
+#include "macro.h"
+#include "stats.h"
+
+#define TYPER_SECTOR_SIZE 512
+
+// Keep this much in the macro queue, at most.
+#define TYPER_QUEUE_STEPS 32
+
+#define X68_SHIFT  0x70
+#define X68_RETURN 0x1D
+#define X68_TAB    0x10
+
+// Bit 7 of the table means the character needs SHIFT.
+#define S(c) ((c) | 0x80)
+
+// JIS layout, as printed on the X68000 keyboard. Letters assume CAPS is off.
+static const uint8_t asciiToX68[128] = {
+    ['\t'] = X68_TAB, ['\n'] = X68_RETURN,
+    [' '] = 0x35,
+    ['!'] = S(0x02), ['"'] = S(0x03), ['#'] = S(0x04), ['$'] = S(0x05),
+    ['%'] = S(0x06), ['&'] = S(0x07), ['\''] = S(0x08), ['('] = S(0x09),
+    [')'] = S(0x0A), ['*'] = S(0x28), ['+'] = S(0x27), [','] = 0x31,
+    ['-'] = 0x0C, ['.'] = 0x32, ['/'] = 0x33,
+    ['0'] = 0x0B, ['1'] = 0x02, ['2'] = 0x03, ['3'] = 0x04, ['4'] = 0x05,
+    ['5'] = 0x06, ['6'] = 0x07, ['7'] = 0x08, ['8'] = 0x09, ['9'] = 0x0A,
+    [':'] = 0x28, [';'] = 0x27, ['<'] = S(0x31), ['='] = S(0x0C),
+    ['>'] = S(0x32), ['?'] = S(0x33), ['@'] = 0x1B,
+    ['A'] = S(0x1E), ['B'] = S(0x2E), ['C'] = S(0x2C), ['D'] = S(0x20),
+    ['E'] = S(0x13), ['F'] = S(0x21), ['G'] = S(0x22), ['H'] = S(0x23),
+    ['I'] = S(0x18), ['J'] = S(0x24), ['K'] = S(0x25), ['L'] = S(0x26),
+    ['M'] = S(0x30), ['N'] = S(0x2F), ['O'] = S(0x19), ['P'] = S(0x1A),
+    ['Q'] = S(0x11), ['R'] = S(0x14), ['S'] = S(0x1F), ['T'] = S(0x15),
+    ['U'] = S(0x17), ['V'] = S(0x2D), ['W'] = S(0x12), ['X'] = S(0x2B),
+    ['Y'] = S(0x16), ['Z'] = S(0x2A),
+    ['['] = 0x1C, ['\\'] = 0x0E, [']'] = 0x29, ['^'] = 0x0D, ['_'] = S(0x34),
+    ['`'] = S(0x1B),
+    ['a'] = 0x1E, ['b'] = 0x2E, ['c'] = 0x2C, ['d'] = 0x20, ['e'] = 0x13,
+    ['f'] = 0x21, ['g'] = 0x22, ['h'] = 0x23, ['i'] = 0x18, ['j'] = 0x24,
+    ['k'] = 0x25, ['l'] = 0x26, ['m'] = 0x30, ['n'] = 0x2F, ['o'] = 0x19,
+    ['p'] = 0x1A, ['q'] = 0x11, ['r'] = 0x14, ['s'] = 0x1F, ['t'] = 0x15,
+    ['u'] = 0x17, ['v'] = 0x2D, ['w'] = 0x12, ['x'] = 0x2B, ['y'] = 0x16,
+    ['z'] = 0x2A,
+    ['{'] = S(0x1C), ['|'] = S(0x0E), ['}'] = S(0x29), ['~'] = S(0x0D),
+};
+
+// What the sector buffer holds once the read in flight completes.
+typedef enum {
+    TYPER_OFF = 0,
+    TYPER_MBR,
+    TYPER_VOLUME,
+    TYPER_DIR,
+    TYPER_FAT,
+    TYPER_TEXT
+} typerState_t;
+
+static uint8_t mscAddr = 0;
+
+static typerState_t state = TYPER_OFF;
+static typerState_t fatReturn;      // Where a FAT lookup was going
+static volatile bool readBusy = false;
+static volatile bool readOk = false;
+
+static uint8_t sector[TYPER_SECTOR_SIZE];
+static uint16_t sectorPos;
+
+// Volume
+static uint32_t volumeLba;
+static bool fat32;
+static uint32_t fatLba;
+static uint32_t dataLba;
+static uint8_t clusterSectors;
+
+// Where we are in the directory or file. Cluster 0 is the FAT16 root
+// directory, which is one fixed run of sectors.
+static uint32_t cluster;
+static uint32_t lba;
+static uint32_t runLeft;
+
+static uint32_t fileLeft;
+static bool shiftDown;
+static uint32_t startMs;
+static uint32_t typed;
+
+static inline uint16_t le16(const uint8_t *p) {
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t le32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+//--------------------------------------------------------------------+
+// Block device
+//--------------------------------------------------------------------+
+
+void tuh_msc_mount_cb(uint8_t dev_addr) {
+    mscAddr = dev_addr;
+}
+
+void tuh_msc_umount_cb(uint8_t dev_addr) {
+    if(dev_addr != mscAddr) return;
+
+    // Its read won't be completing now.
+    typerAbort();
+    mscAddr = 0;
+    readBusy = false;
+}
+
+static bool readComplete(uint8_t devAddr, tuh_msc_complete_data_t const *cbData) {
+    readOk = cbData->csw->status == MSC_CSW_STATUS_PASSED;
+    readBusy = false;
+    return true;
+}
+
+static bool readSector(uint32_t at, typerState_t next) {
+    readBusy = true;
+    state = next;
+    if(tuh_msc_read10(mscAddr, 0, sector, at, 1, readComplete, 0)) return true;
+
+    readBusy = false;
+    return false;
+}
+
+//--------------------------------------------------------------------+
+// FAT
+//--------------------------------------------------------------------+
+
+static uint32_t clusterLba(uint32_t c) {
+    return dataLba + (c - 2) * clusterSectors;
+}
+
+static bool chainEnd(uint32_t c) {
+    return c < 2 || c >= (fat32 ? 0x0FFFFFF8 : 0xFFF8);
+}
+
+// Read the next sector of the directory or file. False at the end of it.
+static bool readNext(typerState_t next) {
+    if(runLeft) {
+        runLeft--;
+        return readSector(lba++, next);
+    }
+
+    if(cluster == 0) return false;
+
+    fatReturn = next;
+    const uint32_t offset = cluster * (fat32 ? 4 : 2);
+    return readSector(fatLba + offset / TYPER_SECTOR_SIZE, TYPER_FAT);
+}
+
+static void startRun(uint32_t c) {
+    cluster = c;
+    lba = clusterLba(c);
+    runLeft = clusterSectors;
+}
+
+// Boot sector of the volume: where everything is.
+static bool mountVolume(void) {
+    const uint8_t *b = sector;
+
+    if(le16(&b[510]) != 0xAA55 || le16(&b[11]) != TYPER_SECTOR_SIZE || !b[13] || !b[16]) return false;
+
+    const uint16_t reserved = le16(&b[14]);
+    const uint16_t rootEntries = le16(&b[17]);
+    const uint32_t fatSectors = le16(&b[22]) ? le16(&b[22]) : le32(&b[36]);
+    const uint32_t totalSectors = le16(&b[19]) ? le16(&b[19]) : le32(&b[32]);
+    const uint32_t rootSectors = (rootEntries * 32 + TYPER_SECTOR_SIZE - 1) / TYPER_SECTOR_SIZE;
+
+    clusterSectors = b[13];
+    fatLba = volumeLba + reserved;
+    const uint32_t rootLba = fatLba + b[16] * fatSectors;
+    dataLba = rootLba + rootSectors;
+
+    if(totalSectors <= dataLba - volumeLba) return false;
+    const uint32_t clusters = (totalSectors - (dataLba - volumeLba)) / clusterSectors;
+
+    // FAT12 is floppy territory, not USB sticks.
+    if(clusters < 4085) return false;
+    fat32 = clusters >= 65525;
+
+    if(fat32) {
+        startRun(le32(&b[44]));
+    }else{
+        cluster = 0;
+        lba = rootLba;
+        runLeft = rootSectors;
+    }
+    return true;
+}
+
+static bool isVolumeBootSector(void) {
+    return (sector[0] == 0xEB || sector[0] == 0xE9) && le16(&sector[11]) == TYPER_SECTOR_SIZE;
+}
+
+// First partition, if it's FAT16 or FAT32.
+static uint32_t firstPartition(void) {
+    if(le16(&sector[510]) != 0xAA55) return 0;
+
+    const uint8_t *p = &sector[446];
+    switch(p[4]) {
+        case 0x04: case 0x06: case 0x0E: case 0x0B: case 0x0C:
+            return le32(&p[8]);
+        default:
+            return 0;
+    }
+}
+
+// A .TXT file in this directory sector. False once there's no point looking further.
+static bool findFile(bool *found) {
+    *found = false;
+
+    for(uint16_t i = 0; i < TYPER_SECTOR_SIZE; i += 32) {
+        const uint8_t *e = &sector[i];
+
+        if(e[0] == 0x00) return false;          // End of directory
+        if(e[0] == 0xE5) continue;              // Deleted
+        if(e[11] & 0x18) continue;              // Volume label, directory, or long name part
+        if(memcmp(&e[8], "TXT", 3)) continue;
+
+        fileLeft = le32(&e[28]);
+        startRun(((uint32_t)le16(&e[20]) << 16) | le16(&e[26]));
+        *found = true;
+        return false;
+    }
+    return true;
+}
+
+//--------------------------------------------------------------------+
+// Typing
+//--------------------------------------------------------------------+
+
+static void finish(void) {
+    if(shiftDown) macroQueue(X68_SHIFT | 0x80, 0);
+    shiftDown = false;
+
+    const uint32_t ms = to_ms_since_boot(get_absolute_time()) - startMs;
+    if(ms) statEvents[STAT_EVT_TYPE_CPS] = (uint32_t)((uint64_t)typed * 1000 / ms);
+
+    state = TYPER_OFF;
+}
+
+// Type what's left of the sector, as far as the queue allows.
+static void typeSector(void) {
+    const uint16_t end = fileLeft < TYPER_SECTOR_SIZE ? fileLeft : TYPER_SECTOR_SIZE;
+
+    while(sectorPos < end) {
+        // Worst case a SHIFT change, the key, and its release.
+        if(macroQueued() > TYPER_QUEUE_STEPS - 3) return;
+
+        const uint8_t ch = sector[sectorPos++];
+        const uint8_t code = ch < 128 ? asciiToX68[ch] : 0;
+
+        if(!code) {
+            // Carriage returns are just half of CRLF.
+            if(ch != '\r') statCount(STAT_EVT_TYPE_DROPS);
+            continue;
+        }
+
+        const bool shift = code & 0x80;
+        if(shift != shiftDown) {
+            macroQueue(shift ? X68_SHIFT : X68_SHIFT | 0x80, 0);
+            shiftDown = shift;
+        }
+
+        macroQueue(code & 0x7F, 0);
+        macroQueue((code & 0x7F) | 0x80, 0);
+        typed++;
+        statCount(STAT_EVT_TYPED_CHARS);
+    }
+
+    fileLeft -= end;
+    sectorPos = 0;
+    if(!fileLeft || !readNext(TYPER_TEXT)) finish();
+}
+
+bool typerStart(void) {
+    if(!mscAddr || state != TYPER_OFF || readBusy) return false;
+    if(tuh_msc_get_block_size(mscAddr, 0) != TYPER_SECTOR_SIZE) return false;
+
+    shiftDown = false;
+    typed = 0;
+    startMs = to_ms_since_boot(get_absolute_time());
+    return readSector(0, TYPER_MBR);
+}
+
+void typerAbort(void) {
+    if(state != TYPER_OFF) finish();
+}
+
+bool typerBusy(void) {
+    return state != TYPER_OFF;
+}
+
+void typerTask(void) {
+    if(state == TYPER_OFF || readBusy) return;
+
+    if(!readOk) {
+        finish();
+        return;
+    }
+
+    bool ok = true;
+
+    switch(state) {
+        case TYPER_MBR:
+            // Sticks are formatted with or without a partition table.
+            if(isVolumeBootSector()) {
+                volumeLba = 0;
+                ok = mountVolume() && readNext(TYPER_DIR);
+            }else{
+                volumeLba = firstPartition();
+                ok = volumeLba && readSector(volumeLba, TYPER_VOLUME);
+            }
+        break;
+
+        case TYPER_VOLUME:
+            ok = mountVolume() && readNext(TYPER_DIR);
+        break;
+
+        case TYPER_DIR: {
+            bool found;
+            const bool more = findFile(&found);
+            if(found) {
+                sectorPos = 0;
+                ok = fileLeft && readNext(TYPER_TEXT);
+            }else{
+                ok = more && readNext(TYPER_DIR);
+            }
+        }
+        break;
+
+        case TYPER_FAT: {
+            const uint32_t offset = (cluster * (fat32 ? 4 : 2)) % TYPER_SECTOR_SIZE;
+            const uint32_t next = fat32 ? le32(&sector[offset]) & 0x0FFFFFFF : le16(&sector[offset]);
+
+            if(chainEnd(next)) {
+                ok = false;
+            }else{
+                startRun(next);
+                ok = readNext(fatReturn);
+            }
+        }
+        break;
+
+        case TYPER_TEXT:
+            typeSector();
+        break;
+
+        default:
+        break;
+    }
+
+    if(!ok) finish();
+}
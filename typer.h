@@ -0,0 +1,20 @@
+// Types a text file from a USB stick into the X68000.
+
+#ifndef _TYPER_H_INCLUDED
+#define _TYPER_H_INCLUDED
+
+#include <stdbool.h>
+
+// Start on the first .TXT file in the stick's root directory. False if
+// there's no stick, or it's already typing.
+bool typerStart(void);
+
+// Stop typing, leaving nothing held down.
+void typerAbort(void);
+
+bool typerBusy(void);
+
+// Main loop. Reads ahead one sector at a time and keeps the macro queue fed.
+void typerTask(void);
+
+#endif
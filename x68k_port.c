@@ -0,0 +1,315 @@
+// X68000 keyboard and mouse port.
+//
+// Everything facing the X68000 runs on core1, so its timing doesn't depend on
+// what the USB stack on core0 is up to. The two cores only share:
+// - kbTxQueue, a lock-free ring of scan codes (core0 in, core1 out)
+// - the mouse accumulator, snapshotted under a hardware spin lock
+// - the latest LED request, published with a sequence number
+//
+// At 2400 baud each byte takes ~4.2ms on the wire, so a rollover burst easily
+// outruns the 32 byte UART FIFO. The ring is drained by the UART TX interrupt.
+//
+// Host commands are handled in the same interrupt, through a table indexed by
+// the command byte. The mouse packet is rebuilt on every USB report, so
+// answering an MSCTRL poll is just three FIFO writes.
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "pico/flash.h"
+#include "hardware/uart.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "x68k_port.h"
+#include "stats.h"
+#include "recorder.h"
+
+// Must be a power of two. Also holds keys back while the host has key data
+// stopped, which can be a while during boot or disk access.
+#define KB_TX_QUEUE_SIZE 256
+
+static uint8_t kbTxStorage[KB_TX_QUEUE_SIZE];
+ring_t kbTxQueue = RING_INIT(kbTxStorage);
+
+static spin_lock_t *mouseLock;
+static uint8_t mouseButtons = 0;
+static int16_t mouseDx = 0, mouseDy = 0;
+static uint8_t mousePacket[3];
+
+// Bound the carried backlog so the pointer doesn't keep drifting long after
+// the mouse has stopped.
+#define MOUSE_CARRY_LIMIT 512
+
+static volatile uint8_t ledState = 0;
+static volatile uint32_t ledSeq = 0;
+
+// Power-on defaults of the real keyboard: 500ms delay, 110ms interval.
+volatile uint8_t x68kRepeatDelay = 3;
+volatile uint8_t x68kRepeatInterval = 4;
+
+volatile bool keyDataEnabled = true;
+
+// Set by core1 once the UARTs are listening.
+static volatile bool portReady = false;
+
+// When the X68000 last sent a command of any kind.
+static volatile uint32_t lastCommandUs = 0;
+static volatile bool commanded = false;
+
+// When the last HID interface mounted, and whether a key has gone out since.
+static volatile uint32_t mountUs = 0;
+static volatile bool mountWaiting = false;
+static bool bootKeySent = false;
+
+static inline int32_t clamp32(int32_t v, int32_t lo, int32_t hi) {
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+// Keep the reply ready to go. Caller must hold mouseLock.
+static void buildMousePacket(void) {
+    // Anything past one packet's worth is carried into the next poll rather
+    // than flagged as overflow and thrown away, so the overflow bits stay clear.
+    mousePacket[0] = mouseButtons;
+    mousePacket[1] = clamp32(mouseDx, -128, 127);
+    mousePacket[2] = clamp32(mouseDy, -128, 127);
+}
+
+//--------------------------------------------------------------------+
+// Core0 side
+//--------------------------------------------------------------------+
+
+// Queue a byte for the keyboard interface. Never waits on the wire.
+// Safe from core0 interrupts (macro playback) as well as the main loop.
+void kbSend(uint8_t c) {
+    const uint64_t start = statNow();
+    const uint32_t irqState = save_and_disable_interrupts();
+    ringPush(&kbTxQueue, c);
+    recorderKeyTx(c);
+
+    // Still masked: an alarm landing halfway through the histogram update
+    // would lose its own.
+    statSince(STAT_ENQUEUE, start);
+    restore_interrupts(irqState);
+
+    // Core1 sleeps until there's something to do.
+    __sev();
+}
+
+void mouseAccumulate(uint8_t buttons, int32_t dx, int32_t dy) {
+    const uint32_t lockState = spin_lock_blocking(mouseLock);
+    mouseDx = clamp32(mouseDx + dx, -MOUSE_CARRY_LIMIT, MOUSE_CARRY_LIMIT);
+    mouseDy = clamp32(mouseDy + dy, -MOUSE_CARRY_LIMIT, MOUSE_CARRY_LIMIT);
+    mouseButtons = buttons;
+    buildMousePacket();
+    spin_unlock(mouseLock, lockState);
+}
+
+uint8_t x68kPortLeds(void) {
+    return ledState;
+}
+
+uint32_t x68kPortMsSinceCommand(void) {
+    if(!commanded) return UINT32_MAX;
+    return (time_us_32() - lastCommandUs) / 1000;
+}
+
+void x68kPortNoteMount(void) {
+    mountUs = time_us_32();
+    __dmb();
+    mountWaiting = true;
+}
+
+bool x68kPortTakeLeds(uint8_t *leds) {
+    static uint32_t seenSeq = 0;
+
+    const uint32_t seq = ledSeq;
+    if(seq == seenSeq) return false;
+
+    __dmb();
+    *leds = ledState;
+    seenSeq = seq;
+    return true;
+}
+
+//--------------------------------------------------------------------+
+// Core1 side
+//--------------------------------------------------------------------+
+
+// Time to the first scan code on the wire, from power-on and from the latest
+// mount. Only costs anything the first time round.
+static void noteFirstKey(void) {
+    if(!bootKeySent) {
+        statEvents[STAT_EVT_BOOT_KEY_MS] = time_us_64() / 1000;
+        bootKeySent = true;
+    }
+
+    if(mountWaiting) {
+        statEvents[STAT_EVT_MOUNT_KEY_MS] = (time_us_32() - mountUs) / 1000;
+        mountWaiting = false;
+    }
+}
+
+// Top up the hardware FIFO from the ring. Caller must keep the IRQ out.
+static void kbTxFill(void) {
+    bool sent = false;
+
+    while(keyDataEnabled && !ringEmpty(&kbTxQueue) && uart_is_writable(KB_UART_ID)) {
+        uart_putc_raw(KB_UART_ID, ringPop(&kbTxQueue));
+        sent = true;
+    }
+
+    if(sent) noteFirstKey();
+
+    // Only ask for the TX interrupt while there's something left we're allowed to send.
+    uart_set_irq_enables(KB_UART_ID, true, keyDataEnabled && !ringEmpty(&kbTxQueue));
+}
+
+static void sendMousePacket(uint32_t pollUs) {
+    uint8_t sent[3];
+
+    const uint32_t lockState = spin_lock_blocking(mouseLock);
+    uart_putc_raw(MOUSE_UART_ID, mousePacket[0]);
+    uart_putc_raw(MOUSE_UART_ID, mousePacket[1]);
+    uart_putc_raw(MOUSE_UART_ID, mousePacket[2]);
+    memcpy(sent, mousePacket, sizeof(sent));
+    mouseDx -= (int8_t)mousePacket[1];
+    mouseDy -= (int8_t)mousePacket[2];
+    buildMousePacket();
+    spin_unlock(mouseLock, lockState);
+
+    // Time from the poll byte interrupt to the first mouse byte hitting the FIFO.
+    statRecord(STAT_MOUSE_POLL, time_us_32() - pollUs);
+    statCount(STAT_EVT_MOUSE_POLLS);
+    recorderMouseTx(sent);
+}
+
+//--------------------------------------------------------------------+
+// Host commands
+//--------------------------------------------------------------------+
+
+typedef void (*commandHandler_t)(uint8_t cmd, uint32_t rxUs);
+
+static uint8_t lastCommand = 0;
+
+// 0x4x replicates the MSCTRL pin on the mouse port. Bit 0 falling means poll now.
+static void cmdMsctrl(uint8_t cmd, uint32_t rxUs) {
+    if(cmd == 0x40 && lastCommand == 0x41) sendMousePacket(rxUs);
+}
+
+// 0x48 stops key data, 0x49 lets it flow again. While stopped, scan codes wait
+// in kbTxQueue and go out in order once the host is ready for them.
+static void cmdKeyData(uint8_t cmd, uint32_t rxUs) {
+    const bool enable = cmd & 1;
+    if(!enable && keyDataEnabled) statCount(STAT_EVT_KEYS_HELD);
+    keyDataEnabled = enable;
+}
+
+// 0x6x and 0x7x program key repeat. Core0 reads them when it next schedules one.
+static void cmdRepeatDelay(uint8_t cmd, uint32_t rxUs) {
+    x68kRepeatDelay = cmd & 0x0F;
+}
+
+static void cmdRepeatInterval(uint8_t cmd, uint32_t rxUs) {
+    x68kRepeatInterval = cmd & 0x0F;
+}
+
+// 0x8x sets the keyboard LEDs. Core0 owns USB, so just publish it.
+static void cmdLeds(uint8_t cmd, uint32_t rxUs) {
+    // CAPS -> CAPS
+    // INS -> NUMLOCK
+    // FULLWIDTH -> SCROLL LOCK
+    // I guess?
+    ledState = ((cmd >> 4) & 1) | (((cmd >> 3) & 1) << 1) | (((cmd >> 6) & 1) << 2);
+    __dmb();
+    ledSeq = ledSeq + 1;
+
+    // Wake core0 if it's idle.
+    __sev();
+}
+
+// Valid, but nothing to do on a USB keyboard: LED brightness (0x54-0x57), TV
+// control enable (0x58-0x59) and OPT.2 TV control (0x5C-0x5D).
+static void cmdNothing(uint8_t cmd, uint32_t rxUs) {
+}
+
+static const commandHandler_t commandTable[256] = {
+    [0x40 ... 0x41] = cmdMsctrl,
+    [0x48 ... 0x49] = cmdKeyData,
+    [0x54 ... 0x59] = cmdNothing,
+    [0x5C ... 0x5D] = cmdNothing,
+    [0x60 ... 0x6F] = cmdRepeatDelay,
+    [0x70 ... 0x7F] = cmdRepeatInterval,
+    [0x80 ... 0xFF] = cmdLeds,
+};
+
+static void handleCommand(uint8_t cmd, uint32_t rxUs) {
+    const commandHandler_t handler = commandTable[cmd];
+
+    if(handler) handler(cmd, rxUs); else statCount(STAT_EVT_UNKNOWN_CMDS);
+    lastCommand = cmd;
+}
+
+static void kbUartIrq(void) {
+    const uint32_t rxUs = time_us_32();
+
+    while(uart_is_readable(KB_UART_ID)) {
+        const uint8_t cmd = uart_getc(KB_UART_ID);
+        recorderKeyRx(cmd);
+        handleCommand(cmd, rxUs);
+    }
+    lastCommandUs = rxUs;
+    commanded = true;
+
+    kbTxFill();
+}
+
+static void core1Main(void) {
+    // Lets core0 park us while it writes settings to flash.
+    flash_safe_execute_core_init();
+
+    uart_init(KB_UART_ID, KB_BAUD_RATE);
+    uart_init(MOUSE_UART_ID, MOUSE_BAUD_RATE);
+    uart_set_format(MOUSE_UART_ID, 8, 2, UART_PARITY_NONE);
+
+    // With the FIFO on, a lone poll byte only raises the RX interrupt after the
+    // 32 bit receive timeout (~13ms here). One byte at a time is plenty at 2400.
+    uart_set_fifo_enabled(KB_UART_ID, false);
+
+    gpio_set_function(KB_UART_TX_PIN, GPIO_FUNC_UART);
+    gpio_set_function(KB_UART_RX_PIN, GPIO_FUNC_UART);
+
+    gpio_set_function(MOUSE_UART_TX_PIN, GPIO_FUNC_UART);
+    gpio_set_function(MOUSE_UART_RX_PIN, GPIO_FUNC_UART);
+
+    // Installed from core1 so the interrupt is taken here, not on the USB core.
+    // Mouse polls are the most timing sensitive thing we do.
+    irq_set_exclusive_handler(KB_UART_IRQ, kbUartIrq);
+    irq_set_priority(KB_UART_IRQ, PICO_HIGHEST_IRQ_PRIORITY);
+    uart_set_irq_enables(KB_UART_ID, true, false);
+    irq_set_enabled(KB_UART_IRQ, true);
+
+    portReady = true;
+    __sev();
+
+    while (true) {
+        // Core0 can't touch the UART, so new bytes are kicked off from here.
+        // Otherwise sleep: kbSend() sends an event, and our own interrupts
+        // wake us too.
+        if(keyDataEnabled && !ringEmpty(&kbTxQueue) && uart_is_writable(KB_UART_ID)) {
+            const uint32_t irqState = save_and_disable_interrupts();
+            kbTxFill();
+            restore_interrupts(irqState);
+        }else{
+            __wfe();
+        }
+    }
+}
+
+// Called from core0. Starts core1, which brings up the UARTs itself, and
+// waits until it has.
+void x68kPortInit(void) {
+    mouseLock = spin_lock_init(spin_lock_claim_unused(true));
+    multicore_launch_core1(core1Main);
+
+    while(!portReady) __wfe();
+}
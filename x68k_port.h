@@ -0,0 +1,53 @@
+// X68000 keyboard and mouse port.
+
+#ifndef _X68K_PORT_H_INCLUDED
+#define _X68K_PORT_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ring.h"
+
+#define KB_UART_ID uart1
+#define KB_UART_IRQ UART1_IRQ
+#define KB_BAUD_RATE 2400
+
+#define KB_UART_TX_PIN 4
+#define KB_UART_RX_PIN 5
+
+#define MOUSE_UART_ID uart0
+#define MOUSE_BAUD_RATE 4800
+
+#define MOUSE_UART_TX_PIN 12
+#define MOUSE_UART_RX_PIN 13
+
+// Bytes waiting to go out to the keyboard interface. Counters live in the ring:
+// overflows is keys dropped, highWater the deepest backlog.
+extern ring_t kbTxQueue;
+
+// False while the X68000 has told the keyboard to hold its key data.
+extern volatile bool keyDataEnabled;
+
+// Everything below is called from core0. x68kPortInit starts core1 and
+// returns once the X68000 side is ready.
+void x68kPortInit(void);
+void kbSend(uint8_t c);
+void mouseAccumulate(uint8_t buttons, int32_t dx, int32_t dy);
+
+// True if the X68000 asked for new LEDs since last time. Bit 0 num, 1 caps, 2 scroll.
+bool x68kPortTakeLeds(uint8_t *leds);
+
+// LEDs as last set by the X68000, whether or not they've been taken.
+uint8_t x68kPortLeds(void);
+
+// Milliseconds since the X68000 last sent a command, polls included. UINT32_MAX
+// if it never has.
+uint32_t x68kPortMsSinceCommand(void);
+
+// A HID interface just mounted. Starts the clock on STAT_EVT_MOUNT_KEY_MS.
+void x68kPortNoteMount(void);
+
+// Key repeat settings as last sent by the X68000, 0-15 each.
+extern volatile uint8_t x68kRepeatDelay;
+extern volatile uint8_t x68kRepeatInterval;
+
+#endif